@@ -1,5 +1,9 @@
 #pragma once
 #include<vector>
+#include<stack>
+#include<cstdint>
+#include<array>
+#include<bitset>
 #include<string>
 #include<set>
 #include<map>
@@ -9,67 +13,157 @@
 
 #include"Vlpp.h"
 #include"RegExpParser.h"
+#include"RegexAst.h"
 
 namespace hscp {
-	struct state;
-	struct transition;
-	// a state in automaton
+	constexpr uint32_t NOSTATE = 0xFFFFFFFF; // no state (index)
+	constexpr uint32_t NOTRANS = 0xFFFFFFFF; // no transition (index)
+	// a state in automaton, transitions going out are chained by index
 	struct state {
-		//std::vector<transition*> ins; // transition comes in
-		std::vector<transition*> trans; // transition functions
-		bool finalState; // is final
+		uint32_t firstTrans = NOTRANS, lastTrans = NOTRANS; // transition functions
+		bool finalState = false; // is final
 		std::string is; // the lexical meaning which this function belongs to
 	};
-	// a transition in automaton; both used to record a fragment in automaton
+	// a transition in automaton
 	struct transition {
 		CharRange input; // function input
-		std::string is; // the lexical meaning which this function belongs to
-		state* from, * to; // where the function comes and goes
+		uint32_t from, to; // where the function comes and goes
+		uint32_t next; // next transition of the same state
+	};
+	// disjoint byte classes, bytes in one class always move to the same states
+	struct ByteClasses {
+		std::array<unsigned char, 256> classOf{}; // byte to class id
+		std::vector<CharRange> ranges; // class id to the continuous bytes it contains
+
+		size_t Count() const { return ranges.size(); }
+		// split bytes at every boundary of inputs, byte 0 (epsilon) is always class 0 alone
+		static ByteClasses Split(const std::vector<CharRange>& inputs) {
+			ByteClasses bc;
+			std::bitset<257> cut; // a class begins at the byte
+			cut.set(0); cut.set(1); cut.set(256);
+			for (const auto& r : inputs) {
+				cut.set(r.from);
+				cut.set(r.to + 1);
+			}
+			int begin = 0;
+			for (int i = 1; i <= 256; i++) {
+				if (!cut[i]) continue;
+				for (int ch = begin; ch < i; ch++) // bytes in [begin, i) share a class
+					bc.classOf[ch] = (unsigned char)bc.ranges.size();
+				bc.ranges.emplace_back(begin, i - 1);
+				begin = i;
+			}
+			return bc;
+		}
+		// split bytes at every boundary of transition inputs
+		static ByteClasses Split(const std::vector<transition>& transitions) {
+			std::vector<CharRange> inputs;
+			for (const auto& t : transitions) {
+				if (t.input != 0) inputs.push_back(t.input); // ignore epsilon
+			}
+			return Split(inputs);
+		}
 	};
-	// a automaton
+	// a automaton, states and transitions live in two arenas and refer to each other by index
 	class Automaton {
+	private:
+		// add fragment of node n of a regex tree starting at state st, return its end
+		uint32_t fragment(const RegexAst& ast, int n, uint32_t st) {
+			const auto& nd = ast.nodes[n];
+			uint32_t ed, in;
+			switch (nd.type)
+			{
+			case RegexAst::Set:
+				ed = NewState();
+				for (const auto& chr : RegexAst::Ranges(nd.set))
+					NewTransition(st, ed, chr);
+				return ed;
+			case RegexAst::Concat:
+				for (int k : nd.kids)
+					st = fragment(ast, k, st); // next starts where this ends
+				return st;
+			case RegexAst::Alter:
+				ed = NewState();
+				for (int k : nd.kids)
+					NewEpsilon(fragment(ast, k, st), ed);
+				return ed;
+			case RegexAst::Star: // loop at a new state, st may be in a loop of the fragment before
+				in = NewState();
+				NewEpsilon(st, in);
+				NewEpsilon(fragment(ast, nd.kids[0], in), in);
+				return in;
+			case RegexAst::Plus:
+				in = NewState();
+				NewEpsilon(st, in);
+				ed = fragment(ast, nd.kids[0], in);
+				NewEpsilon(ed, in);
+				return ed;
+			default: // optional, a new end as the end of the fragment may go back into it
+				ed = NewState();
+				NewEpsilon(st, ed);
+				NewEpsilon(fragment(ast, nd.kids[0], st), ed);
+				return ed;
+			}
+		}
 	public:
-		std::vector<vl::Ptr<state>> states;
-		std::vector<vl::Ptr<transition>> transitions;
-		std::set<CharRange> inputs;
-		state* startState = nullptr; // the very beginning of this automaton
+		std::vector<state> states;
+		std::vector<transition> transitions;
+		ByteClasses classes; // input alphabet of dfa, transitions are labeled by class ranges
+		uint32_t startState = NOSTATE; // the very beginning of this automaton
 
 		// add a state
-		state* NewState(const std::string& is = "") {
-			state* t = new state{ {},false, is };
-			states.push_back(t);
-			return t;
+		uint32_t NewState(const std::string& is = "") {
+			states.push_back({ NOTRANS, NOTRANS, false, is });
+			return (uint32_t)states.size() - 1;
 		}
 		// add a transition
-		transition* NewTransition(state* from, state* to, CharRange chr, const std::string& is) {
-			transition* t = new transition{ chr,is,from,to };
-			from->trans.push_back(t);
-			//to->ins.push_back(t);
-			transitions.push_back(t);
+		uint32_t NewTransition(uint32_t from, uint32_t to, CharRange chr) {
+			uint32_t t = (uint32_t)transitions.size();
+			transitions.push_back({ chr, from, to, NOTRANS });
+			auto& s = states[from];
+			if (s.lastTrans == NOTRANS) // append to the chain of from state
+				s.firstTrans = t;
+			else
+				transitions[s.lastTrans].next = t;
+			s.lastTrans = t;
 			return t;
 		}
 		// add a transition takes epsilon
-		transition* NewEpsilon(state* from, state* to) {
-			return NewTransition(from, to, 0, "");
+		uint32_t NewEpsilon(uint32_t from, uint32_t to) {
+			return NewTransition(from, to, 0);
+		}
+		// for each transition going out of a state do an action
+		template<typename F>
+		void EachTransition(uint32_t s, F&& ac) const {
+			for (uint32_t t = states[s].firstTrans; t != NOTRANS; t = transitions[t].next)
+				ac(transitions[t]);
 		}
 		// print all transitions
 		void print() {
 			for (const auto& t : transitions) {
-				std::cout << t->from << "  [" << t->input << "]  " << t->to << "  " << (t->to->finalState) << '\n';
+				std::cout << t.from << "  [" << t.input << "]  " << t.to << "  " << (states[t.to].finalState) << '\n';
 			}
 		}
+		// copy states and transitions of another automaton to the end of arenas, return the index offset
+		uint32_t Splice(const Automaton& o) {
+			uint32_t so = (uint32_t)states.size(), to = (uint32_t)transitions.size();
+			auto shift = [](uint32_t i, uint32_t offset) { return i == NOTRANS ? i : i + offset; };
+			states.reserve(states.size() + o.states.size());
+			transitions.reserve(transitions.size() + o.transitions.size());
+			for (const auto& s : o.states)
+				states.push_back({ shift(s.firstTrans, to), shift(s.lastTrans, to), s.finalState, s.is });
+			for (const auto& t : o.transitions)
+				transitions.push_back({ t.input, t.from + so, t.to + so, shift(t.next, to) });
+			return so;
+		}
 		
 		// generate nfa from postfix regular expression
 		static Automaton RegexPost2NFA(const std::vector<regextok>& regex, const std::string& is) {
-			std::stack<transition*> subAutos; // a stack for fragments
-			auto newSubs = [](state* begin, state* end) { // local function to create a fragment
-				transition* t = new transition{ 255,"",begin,end }; // record start and end state of the fragment
-				return t;
-			};
+			std::stack<std::pair<uint32_t, uint32_t>> subAutos; // a stack for fragments, start and end state of each
 			Automaton nfa;
 
-			transition* sub1, * sub2;
-			state* st, * ed;
+			std::pair<uint32_t, uint32_t> sub1, sub2;
+			uint32_t st, ed;
 			for (auto i = regex.begin(); i != regex.end(); ++i) {
 				if (*i == '|') { // parallel two fragments
 					// get fragments
@@ -79,20 +173,20 @@ namespace hscp {
 					st = nfa.NewState();
 					ed = nfa.NewState();
 					// use epsilon build fragment
-					nfa.NewEpsilon(st, sub1->from);
-					nfa.NewEpsilon(st, sub2->from);
-					nfa.NewEpsilon(sub1->to, ed);
-					nfa.NewEpsilon(sub2->to, ed);
+					nfa.NewEpsilon(st, sub1.first);
+					nfa.NewEpsilon(st, sub2.first);
+					nfa.NewEpsilon(sub1.second, ed);
+					nfa.NewEpsilon(sub2.second, ed);
 
-					subAutos.push(newSubs(st, ed)); // push fragment
+					subAutos.push({ st, ed }); // push fragment
 				}
 				else if (*i == '&') { // concatenate two fragments
 					sub1 = subAutos.top(); subAutos.pop(); // right
 					sub2 = subAutos.top(); subAutos.pop(); // left
 					// use epsilon connect fragments
-					nfa.NewEpsilon(sub2->to, sub1->from);
+					nfa.NewEpsilon(sub2.second, sub1.first);
 
-					subAutos.push(newSubs(sub2->from, sub1->to)); // push fragment
+					subAutos.push({ sub2.first, sub1.second }); // push fragment
 				}
 				else if (*i == '*') { // closure
 					sub1 = subAutos.top(); subAutos.pop(); // the symbol
@@ -101,11 +195,11 @@ namespace hscp {
 					ed = nfa.NewState();
 					// use epsilon build fragment
 					nfa.NewEpsilon(st, ed);
-					nfa.NewEpsilon(st, sub1->from);
-					nfa.NewEpsilon(sub1->to, ed);
-					nfa.NewEpsilon(sub1->to, sub1->from);
+					nfa.NewEpsilon(st, sub1.first);
+					nfa.NewEpsilon(sub1.second, ed);
+					nfa.NewEpsilon(sub1.second, sub1.first);
 
-					subAutos.push(newSubs(st, ed)); // push fragment
+					subAutos.push({ st, ed }); // push fragment
 				}
 				else if (*i == '+') { // positive closure
 					sub1 = subAutos.top(); subAutos.pop(); // the symbol
@@ -113,11 +207,11 @@ namespace hscp {
 					st = nfa.NewState();
 					ed = nfa.NewState();
 					// use epsilon build fragment
-					nfa.NewEpsilon(st, sub1->from);
-					nfa.NewEpsilon(sub1->to, ed);
-					nfa.NewEpsilon(sub1->to, sub1->from);
+					nfa.NewEpsilon(st, sub1.first);
+					nfa.NewEpsilon(sub1.second, ed);
+					nfa.NewEpsilon(sub1.second, sub1.first);
 
-					subAutos.push(newSubs(st, ed)); // push fragment
+					subAutos.push({ st, ed }); // push fragment
 				}
 				else if (*i == '?') { // optional
 					sub1 = subAutos.top(); subAutos.pop(); // the symbol
@@ -126,48 +220,82 @@ namespace hscp {
 					ed = nfa.NewState();
 					// use epsilon build fragment
 					nfa.NewEpsilon(st, ed);
-					nfa.NewEpsilon(st, sub1->from);
-					nfa.NewEpsilon(sub1->to, ed);
+					nfa.NewEpsilon(st, sub1.first);
+					nfa.NewEpsilon(sub1.second, ed);
 
-					subAutos.push(newSubs(st, ed)); // push fragment
+					subAutos.push({ st, ed }); // push fragment
+				}
+				else if (*i == '{') { // repetition
+					throw std::exception("repetition is built from syntax tree, see RegexAst2NFA");
 				}
 				else // normal character
 				{
 					st = nfa.NewState();
 					ed = nfa.NewState();
 					// build char transition
-					nfa.NewTransition(st, ed, *i, is);
+					nfa.NewTransition(st, ed, *i);
 
-					subAutos.push(newSubs(st, ed)); // push fragment
+					subAutos.push({ st, ed }); // push fragment
 				}
 			}
 
 			// the fragment left is whole automaton
-			nfa.startState = subAutos.top()->from; // set start
-			subAutos.top()->to->finalState = true; // set finish
-			subAutos.top()->to->is = is;
+			nfa.startState = subAutos.top().first; // set start
+			nfa.states[subAutos.top().second].finalState = true; // set finish
+			nfa.states[subAutos.top().second].is = is;
 			return std::move(nfa);
 		}
+		// generate nfa from simplified regex tree, with fewer states and epsilons than from postfix:
+		// a set of ranges is one step, and a fragment starts at the end of the one before it in a concatenation
+		// as no fragment has transitions into its start, so nothing can go back from one to the one before
+		static Automaton RegexAst2NFA(const RegexAst& ast, const std::string& is) {
+			Automaton nfa;
+			if (ast.root == -1) return nfa;
+			nfa.startState = nfa.NewState();
+			auto ed = nfa.fragment(ast, ast.root, nfa.startState);
+			nfa.states[ed].finalState = true;
+			nfa.states[ed].is = is;
+			return nfa;
+		}
 		// merge two parallel automaton
-		static Automaton Merge(Automaton& nfa1, Automaton& nfa2) {
+		static Automaton Merge(const Automaton& nfa1, const Automaton& nfa2) {
 			Automaton nfa;
+			nfa.states.reserve(1 + nfa1.states.size() + nfa2.states.size());
+			nfa.transitions.reserve(2 + nfa1.transitions.size() + nfa2.transitions.size());
 			auto st = nfa.NewState();
 			nfa.startState = st;
 
-			if (nfa1.startState != nullptr) { // check empty automaton
+			if (nfa1.startState != NOSTATE) { // check empty automaton
 				// automaton1 to new automaton
-				nfa.NewEpsilon(st, nfa1.startState); 
-				std::copy(nfa1.states.begin(), nfa1.states.end(), std::back_inserter(nfa.states));
-				std::copy(nfa1.transitions.begin(), nfa1.transitions.end(), std::back_inserter(nfa.transitions));
+				auto offset = nfa.Splice(nfa1);
+				nfa.NewEpsilon(st, nfa1.startState + offset);
 			}
-			if (nfa2.startState != nullptr) { // check empty automaton
+			if (nfa2.startState != NOSTATE) { // check empty automaton
 				// automaton2 to new automaton
-				nfa.NewEpsilon(st, nfa2.startState); 
-				std::copy(nfa2.states.begin(), nfa2.states.end(), std::back_inserter(nfa.states));
-				std::copy(nfa2.transitions.begin(), nfa2.transitions.end(), std::back_inserter(nfa.transitions));
+				auto offset = nfa.Splice(nfa2);
+				nfa.NewEpsilon(st, nfa2.startState + offset);
 			}
 
 			return std::move(nfa);
 		}
+		// merge many parallel automatons at once, states keep the order of automatons
+		static Automaton Merge(const std::vector<Automaton>& nfas) {
+			Automaton nfa;
+			size_t states = 1, transitions = nfas.size();
+			for (const auto& a : nfas) {
+				states += a.states.size();
+				transitions += a.transitions.size();
+			}
+			nfa.states.reserve(states); // every automaton is copied once
+			nfa.transitions.reserve(transitions);
+			auto st = nfa.NewState();
+			nfa.startState = st;
+			for (const auto& a : nfas) {
+				if (a.startState == NOSTATE) continue; // empty automaton
+				auto offset = nfa.Splice(a);
+				nfa.NewEpsilon(st, a.startState + offset);
+			}
+			return nfa;
+		}
 	};
 }
\ No newline at end of file
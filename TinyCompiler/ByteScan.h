@@ -0,0 +1,201 @@
+#pragma once
+#include<cstdint>
+#include<cstddef>
+#include<vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define HSCP_X64
+#include<immintrin.h>
+#ifdef _MSC_VER
+#include<intrin.h>
+#define HSCP_TARGET_SSSE3
+#define HSCP_TARGET_AVX2
+#else
+#define HSCP_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define HSCP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace hscp {
+	// a set of bytes, with nibble tables to look it up by shuffles
+	struct ByteSet {
+		bool has[256] = {};
+		// bit (ch >> 4) of low[ch & 15] tells ch is in set, for ch < 0x80, high is for the others
+		alignas(16) unsigned char low[16] = {}, high[16] = {};
+
+		void Add(unsigned char ch) {
+			has[ch] = true;
+			(ch < 0x80 ? low : high)[ch & 15] |= (unsigned char)(1 << ((ch >> 4) & 7));
+		}
+	};
+	// find the end of a byte run 16 or 32 bytes at a time, or newlines of a text
+	// a run is made of bytes in a set of at most 4 (like spaces), or of bytes out of it (like a comment body before its terminator)
+	// or of bytes in any ByteSet (like letters and digits of an identifier)
+	class ByteScan {
+	public:
+		enum Level { Scalar, SSE2, SSSE3, AVX2 };
+	private:
+		// highest level supported by this cpu
+		static Level supported() {
+#ifdef HSCP_X64
+#ifdef _MSC_VER
+			int r[4];
+			__cpuid(r, 1);
+			bool osxsave = (r[2] & (1 << 27)) != 0;
+			Level lv = (r[2] & (1 << 9)) != 0 ? SSSE3 : SSE2;
+			if (lv < SSSE3 || !osxsave || (_xgetbv(0) & 6) != 6) return lv; // os doesn't save ymm registers
+			__cpuidex(r, 7, 0);
+			return (r[1] & (1 << 5)) != 0 ? AVX2 : lv;
+#else
+			if (!__builtin_cpu_supports("ssse3")) return SSE2;
+			return __builtin_cpu_supports("avx2") ? AVX2 : SSSE3;
+#endif
+#else
+			return Scalar;
+#endif
+		}
+		static Level& level() {
+			static Level lv = supported();
+			return lv;
+		}
+		static int lowBit(uint32_t w) {
+#ifdef _MSC_VER
+			unsigned long i;
+			_BitScanForward(&i, w);
+			return (int)i;
+#else
+			return __builtin_ctz(w);
+#endif
+		}
+		// add offset after each newline of a block by its newline mask, base is the offset of the block
+		static void addLines(uint32_t nl, uint32_t base, std::vector<uint32_t>& starts) {
+			for (; nl; nl &= nl - 1) starts.push_back(base + lowBit(nl) + 1);
+		}
+		static const char* scalar(const char* p, const char* end, const unsigned char set[4], bool in) {
+			for (; p != end; p++) {
+				unsigned char ch = *p;
+				if ((ch == set[0] || ch == set[1] || ch == set[2] || ch == set[3]) != in) break;
+			}
+			return p;
+		}
+		static const char* scalar(const char* p, const char* end, const ByteSet& set) {
+			for (; p != end && set.has[(unsigned char)*p]; p++);
+			return p;
+		}
+		static void scalarLines(const char* text, size_t from, size_t to, std::vector<uint32_t>& starts) {
+			for (size_t i = from; i < to; i++)
+				if (text[i] == '\n') starts.push_back((uint32_t)i + 1);
+		}
+#ifdef HSCP_X64
+		static const char* sse2(const char* p, const char* end, const unsigned char set[4], bool in) {
+			const __m128i s0 = _mm_set1_epi8((char)set[0]), s1 = _mm_set1_epi8((char)set[1]), s2 = _mm_set1_epi8((char)set[2]), s3 = _mm_set1_epi8((char)set[3]);
+			uint32_t flip = in ? 0xFFFF : 0; // run of bytes in set ends at a byte out of it
+			for (; end - p >= 16; p += 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				__m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, s0), _mm_cmpeq_epi8(v, s1)), _mm_or_si128(_mm_cmpeq_epi8(v, s2), _mm_cmpeq_epi8(v, s3)));
+				uint32_t stop = (uint32_t)_mm_movemask_epi8(hit) ^ flip;
+				if (stop != 0) return p + lowBit(stop);
+			}
+			return scalar(p, end, set, in);
+		}
+		HSCP_TARGET_AVX2 static const char* avx2(const char* p, const char* end, const unsigned char set[4], bool in) {
+			const __m256i s0 = _mm256_set1_epi8((char)set[0]), s1 = _mm256_set1_epi8((char)set[1]), s2 = _mm256_set1_epi8((char)set[2]), s3 = _mm256_set1_epi8((char)set[3]);
+			uint32_t flip = in ? 0xFFFFFFFF : 0;
+			for (; end - p >= 32; p += 32) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)p);
+				__m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, s0), _mm256_cmpeq_epi8(v, s1)), _mm256_or_si256(_mm256_cmpeq_epi8(v, s2), _mm256_cmpeq_epi8(v, s3)));
+				uint32_t stop = (uint32_t)_mm256_movemask_epi8(hit) ^ flip;
+				if (stop != 0) return p + lowBit(stop);
+			}
+			return sse2(p, end, set, in);
+		}
+		// bytes of v out of set: bit of a byte is picked from the nibble tables by its low half, then tested by its high half
+		HSCP_TARGET_SSSE3 static __m128i outOf(__m128i v, __m128i low, __m128i high, __m128i bits) {
+			__m128i row = _mm_or_si128(_mm_shuffle_epi8(low, v), _mm_shuffle_epi8(high, _mm_xor_si128(v, _mm_set1_epi8((char)0x80)))); // index with top bit set gives 0
+			__m128i bit = _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F)));
+			return _mm_cmpeq_epi8(_mm_and_si128(row, bit), _mm_setzero_si128());
+		}
+		HSCP_TARGET_SSSE3 static const char* ssse3(const char* p, const char* end, const ByteSet& set) {
+			const __m128i low = _mm_load_si128((const __m128i*)set.low), high = _mm_load_si128((const __m128i*)set.high);
+			const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+			for (; end - p >= 16; p += 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				uint32_t stop = (uint32_t)_mm_movemask_epi8(outOf(v, low, high, bits));
+				if (stop != 0) return p + lowBit(stop);
+			}
+			return scalar(p, end, set);
+		}
+		HSCP_TARGET_AVX2 static const char* avx2(const char* p, const char* end, const ByteSet& set) {
+			const __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)set.low)); // shuffles work in each 128 bit lane
+			const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)set.high));
+			const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+			const __m256i top = _mm256_set1_epi8((char)0x80), nibble = _mm256_set1_epi8(0x0F);
+			for (; end - p >= 32; p += 32) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)p);
+				__m256i row = _mm256_or_si256(_mm256_shuffle_epi8(low, v), _mm256_shuffle_epi8(high, _mm256_xor_si256(v, top)));
+				__m256i bit = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+				uint32_t stop = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(row, bit), _mm256_setzero_si256()));
+				if (stop != 0) return p + lowBit(stop);
+			}
+			return ssse3(p, end, set);
+		}
+		static void sse2Lines(const char* text, size_t from, size_t to, std::vector<uint32_t>& starts) {
+			const __m128i nl = _mm_set1_epi8('\n');
+			for (; to - from >= 16; from += 16)
+				addLines((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(text + from)), nl)), (uint32_t)from, starts);
+			scalarLines(text, from, to, starts);
+		}
+		HSCP_TARGET_AVX2 static void avx2Lines(const char* text, size_t from, size_t to, std::vector<uint32_t>& starts) {
+			const __m256i nl = _mm256_set1_epi8('\n');
+			for (; to - from >= 32; from += 32)
+				addLines((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(text + from)), nl)), (uint32_t)from, starts);
+			sse2Lines(text, from, to, starts);
+		}
+#endif
+	public:
+		// level in use
+		static Level Current() {
+			return level();
+		}
+		// use a lower level (for benchmark), limited to what the cpu supports
+		static void Use(Level lv) {
+			level() = lv < supported() ? lv : supported();
+		}
+		// end of run from p: first byte out of set if in is true, else first byte in set
+		// set has 4 bytes, repeat one to use fewer
+		static const char* Run(const char* p, const char* end, const unsigned char set[4], bool in) {
+#ifdef HSCP_X64
+			switch (level()) {
+			case AVX2: return avx2(p, end, set, in);
+			case SSSE3:
+			case SSE2: return sse2(p, end, set, in);
+			default: break;
+			}
+#endif
+			return scalar(p, end, set, in);
+		}
+		// end of run from p: first byte out of set
+		static const char* Run(const char* p, const char* end, const ByteSet& set) {
+#ifdef HSCP_X64
+			switch (level()) {
+			case AVX2: return avx2(p, end, set);
+			case SSSE3: return ssse3(p, end, set);
+			default: break;
+			}
+#endif
+			return scalar(p, end, set);
+		}
+		// add offset of the byte after each newline of text in [from, to) to starts, in order
+		static void Lines(const char* text, size_t from, size_t to, std::vector<uint32_t>& starts) {
+#ifdef HSCP_X64
+			switch (level()) {
+			case AVX2: return avx2Lines(text, from, to, starts);
+			case SSSE3:
+			case SSE2: return sse2Lines(text, from, to, starts);
+			default: break;
+			}
+#endif
+			scalarLines(text, from, to, starts);
+		}
+	};
+}
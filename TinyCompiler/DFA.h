@@ -1,135 +1,201 @@
 #pragma once
 #include<map>
 #include<set>
+#include<unordered_map>
 #include<functional>
+#include<algorithm>
+#include<cstdint>
+#ifdef _MSC_VER
+#include<intrin.h>
+#endif
 
 #include"Automaton.h"
 
 
 namespace hscp {
+	// index of the lowest set bit
+	inline int lowestBit(uint64_t w) {
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanForward64(&i, w);
+		return (int)i;
+#else
+		return __builtin_ctzll(w);
+#endif
+	}
+	// a set of densely numbered nfa states stored as bitset, hashed once it is complete
+	// words out of [lo, hi) are all zero, so a set of a few close states is walked and compared quickly in a big nfa
+	struct StateSet {
+		std::vector<uint64_t> bits;
+		size_t lo = 0, hi = 0; // range of words that may be non-zero
+		size_t hash = 0;
+
+		StateSet(size_t n = 0) :bits((n + 63) / 64, 0), lo(bits.size()) {}
+		void Insert(int s) {
+			size_t i = s >> 6;
+			bits[i] |= 1ull << (s & 63);
+			if (i < lo) lo = i;
+			if (i + 1 > hi) hi = i + 1;
+		}
+		bool Has(int s) const { return (bits[s >> 6] >> (s & 63)) & 1; }
+		void Union(const StateSet& o) {
+			for (size_t i = o.lo; i < o.hi; i++) bits[i] |= o.bits[i];
+			if (o.lo < lo) lo = o.lo;
+			if (o.hi > hi) hi = o.hi;
+		}
+		bool Empty() const {
+			for (size_t i = lo; i < hi; i++) if (bits[i]) return false;
+			return true;
+		}
+		// for each member in increasing order do an action
+		template<typename F>
+		void ForEach(F&& ac) const {
+			for (size_t i = lo; i < hi; i++)
+				for (uint64_t w = bits[i]; w; w &= w - 1)
+					ac((int)(i * 64 + lowestBit(w)));
+		}
+		// compute hash after all insertion
+		void Rehash() {
+			hash = lo;
+			for (size_t i = lo; i < hi; i++) hash ^= std::hash<uint64_t>()(bits[i]) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+		}
+		bool operator==(const StateSet& o) const {
+			return hash == o.hash && lo == o.lo && hi == o.hi && std::equal(bits.begin() + lo, bits.begin() + hi, o.bits.begin() + lo);
+		}
+	};
+	struct StateSetHash {
+		size_t operator()(const StateSet& s) const { return s.hash; }
+	};
+
 	class DFAConverter {
 	private:
 		const Automaton& nfa;
 		Automaton dfa;
-		std::map<std::set<state*>, state*> states_to_dfa_s; // map nfa states to dfa state
-		std::set<std::set<state*>> visited; // store visited [states] in state construction
-		std::set<CharRange> inputs; // all valid input
+		std::vector<std::vector<std::pair<CharRange, int>>> moves; // input transitions of each nfa state
+		std::vector<std::vector<int>> epsilons; // epsilon transitions of each nfa state
+		std::vector<StateSet> closures; // e-closure of each nfa state which has epsilon transitions
+		std::vector<int> closureOf; // index in closures of each nfa state, -1 if the closure is itself
+		int start = -1; // id of nfa start state
+		std::unordered_map<StateSet, uint32_t, StateSetHash> states_to_dfa_s; // map nfa states to dfa state
+		std::vector<std::pair<StateSet, uint32_t>> work; // dfa states not visited yet
+		ByteClasses classes; // input alphabet, bytes in a class move alike
 
-		// get input from nfa transitions
+		// split all inputs of nfa transitions into byte classes
 		void getInputs() {
-			// traverse trasition to get inputs
+			classes = ByteClasses::Split(nfa.transitions);
+		}
+		// collect transitions of nfa states by id
+		void collectTransitions() {
+			if (nfa.startState != NOSTATE)
+				start = (int)nfa.startState;
+			moves.resize(nfa.states.size());
+			epsilons.resize(nfa.states.size());
 			for (const auto& t : nfa.transitions) {
-				if (t->input != 0) {
-					if (t->input.isSingle()) // not a range
-						inputs.emplace(t->input);
-					else // is range
-						for (int i = t->input.from; i <= t->input.to; i++)
-							inputs.emplace(i);
-				}
+				if (t.input == 0)
+					epsilons[t.from].push_back((int)t.to);
+				else
+					moves[t.from].emplace_back(t.input, (int)t.to);
 			}
 		}
-		// tell a set of states is visited
-		bool isVisited(const std::set<state*>& ss) {
-			return visited.find(ss) != visited.end();
-		}
-		// for each state's transition do an action
-		void iterateTransitions(std::set<state*> states, std::function<void(state*, transition*)> ac) {
-			for (const auto& s : states) {
-				if (s->trans.size() == 0)
-					ac(s, nullptr); // for states have no transitions out
-				else
-					for (const auto& t : s->trans) {
-						ac(s, t);
+		// generate e-closure of every nfa state once, with a worklist instead of recursion
+		void epsilonClosures() {
+			closureOf.assign(nfa.states.size(), -1);
+			std::vector<int> stack;
+			for (size_t s = 0; s < nfa.states.size(); s++) {
+				if (epsilons[s].empty()) continue; // closure of a state without epsilon is itself
+				StateSet closed(nfa.states.size());
+				closed.Insert((int)s); // add the state itself
+				stack.push_back((int)s);
+				while (!stack.empty()) {
+					int c = stack.back(); stack.pop_back();
+					for (int to : epsilons[c]) {
+						if (!closed.Has(to)) { // has epsilon transition to state not included
+							closed.Insert(to);
+							stack.push_back(to); // continue closure
+						}
 					}
+				}
+				closureOf[s] = (int)closures.size();
+				closures.push_back(std::move(closed));
 			}
 		}
-		// generate e-closure set of states
-		void epsilonClosure(const std::set<state*>& states, std::set<state*>& closed) {
-			iterateTransitions(states, [this, &closed](state* s, transition* t) { // for each transition do
-				closed.insert(s); // add the state itself
-
-				if (t != nullptr && t->input == 0 && closed.find(t->to) == closed.end()) { // has epsilon transition to state not included
-					closed.insert(t->to); // add state
-
-					epsilonClosure({ t->to }, closed); // continue closure
-				}
-				});
+		// add e-closure of a state to set
+		void addClosure(int s, StateSet& dst) const {
+			if (closureOf[s] == -1)
+				dst.Insert(s);
+			else
+				dst.Union(closures[closureOf[s]]);
 		}
-		// from current state read a input and go to next
-		void toAdvance(const std::set<state*>& states, std::set<state*>& dst, unsigned char input) {
-			iterateTransitions(states, [&dst, input](state* s, transition* t) { // for each transition do
-				if (t != nullptr && t->input.from <= input && t->input.to >= input) { // contain valid trasition
-					dst.insert(t->to); // one of the next state, add to destination set
+		// from current states read every input class and go to next, closure included
+		// states are walked once, next[c] gets the states class c moves to and touched lists classes in order that move at all
+		void advanceAll(const StateSet& states, std::vector<StateSet>& next, std::vector<int>& touched) {
+			states.ForEach([this, &next, &touched](int s) {
+				for (const auto& m : moves[s]) {
+					for (int c = classes.classOf[m.first.from]; c <= classes.classOf[m.first.to]; c++) { // classes covered by the input
+						auto& dst = next[c];
+						if (dst.bits.empty()) {
+							dst = StateSet(nfa.states.size());
+							touched.push_back(c);
+						}
+						if (!dst.Has(m.second)) addClosure(m.second, dst);
+					}
 				}
 				});
+			std::sort(touched.begin(), touched.end());
 		}
-		// get a not visited set of states from all
-		std::set<state*> getNonVisited() {
-			for (const auto& ss : states_to_dfa_s) {
-				if (!isVisited(ss.first)) {
-					return ss.first;
-				}
-			}
-			return {}; // no not visited
-		}
-		// set states in dfa final states, which contains final state in nfa
-		void setEndStates() {
-			for (const auto& ss_s : states_to_dfa_s) {
-				std::string is;
-				ss_s.second->finalState = ss_s.first.end() != std::find_if(ss_s.first.begin(), ss_s.first.end(), [&ss_s](state* s) {
-					if (s->finalState) {
-						ss_s.second->is = s->is;
-						return true;
-					}
-					return false;
-				}); // find a final state and get its lexical meaning
+		// get dfa state of a set of nfa states, created if new
+		uint32_t getState(StateSet&& ss) {
+			ss.Rehash();
+			auto it = states_to_dfa_s.find(ss);
+			if (it != states_to_dfa_s.end()) return it->second;
 
+			uint32_t n = dfa.NewState();
+			// a final state in nfa makes the dfa state final, when several rules end here the rule defined first wins
+			int win = -1;
+			ss.ForEach([this, &win](int s) {
+				if (win == -1 && nfa.states[s].finalState) win = s;
+				});
+			if (win != -1) {
+				dfa.states[n].finalState = true;
+				dfa.states[n].is = nfa.states[win].is;
 			}
+			states_to_dfa_s.emplace(ss, n);
+			work.emplace_back(std::move(ss), n); // not visited yet
+			return n;
 		}
 		// converter
 		Automaton dfaConverter() {
-			dfa.startState = dfa.NewState();
-			std::set<state*> t;
-
-			epsilonClosure({ nfa.startState }, t);
-			states_to_dfa_s.emplace(t, dfa.startState); // getting initial state
-
-			std::set<state*> ss;  // nonvisited states set
-			std::set<state*> empty = {}; // to compare
+			StateSet t(nfa.states.size());
+			addClosure(start, t);
+			dfa.startState = getState(std::move(t)); // getting initial state
 
-			while ((ss = getNonVisited()) != empty) // get state left
+			std::vector<StateSet> next(classes.Count());
+			std::vector<int> touched;
+			while (!work.empty()) // get state left
 			{
-				visited.insert(ss); // now this set is visited
-				for (const auto& i : inputs) { // for each input get a new transition/state(set)
-					std::set<state*> t1, t2;
-					// move to next
-					toAdvance(ss, t1, i);
-
-					epsilonClosure(t1, t2);
-
-					if (t2 == empty) continue;
-
-					if (!isVisited(t2)) { // it's a new state
-						if (states_to_dfa_s.find(t2) == states_to_dfa_s.end()) {
-							state* n = dfa.NewState();
-							states_to_dfa_s.emplace(t2, n);
-						}
-					}
-					// whatever, there's new transition
-					dfa.NewTransition(states_to_dfa_s[ss], states_to_dfa_s[t2], i, "");
-				}
+				auto [ss, from] = std::move(work.back()); work.pop_back(); // now this set is visited
+				touched.clear();
+				advanceAll(ss, next, touched);
+				for (int c : touched) // for each input class moving somewhere get a new transition/state(set)
+					dfa.NewTransition(from, getState(std::move(next[c])), classes.ranges[c]);
+				for (int c : touched)
+					next[c] = StateSet(); // moved from, empty again
 			}
-			setEndStates();
 			return std::move(dfa);
 		}
 		// convert to dfa
 		DFAConverter(const Automaton& nfa) :nfa(nfa) {
 			// get all possible input
 			getInputs();
+			// transitions by nfa state
+			collectTransitions();
+			// closure of each state
+			epsilonClosures();
 			// inner converter
-			dfa = dfaConverter();
-			// set inputs
-			dfa.inputs = this->inputs;
+			if (start != -1)
+				dfa = dfaConverter();
+			// set input classes
+			dfa.classes = this->classes;
 		}
 		// export dfa
 		Automaton Export() {
@@ -142,97 +208,150 @@ namespace hscp {
 		}
 	};
 
-	// minimizer
+	// minimizer, hopcroft partition refinement over integer states and class-indexed transitions
 	Automaton DFAminimizer(const Automaton& dfa) {
 		Automaton mindfa;
-		std::vector<std::set<state*>> classified; // sets of equivalent states
-		// get set index in classified group local function
-		auto getSetno = [&classified](state* s) {
-			for (size_t i = 0; i < classified.size(); i++)
-			{
-				if (classified[i].find(s) != classified[i].end()) {
-					return i;
+		if (dfa.startState == NOSTATE) return mindfa; // empty automaton
+
+		const auto& bc = dfa.classes;
+		const int C = (int)bc.Count();
+		const int n = (int)dfa.states.size() + 1; // the last one is a sink completing the dfa
+		const int sink = n - 1;
+
+		// complete transition table, missing ones go to sink
+		const auto& origin = dfa.states;
+		std::vector<int> delta((size_t)n * C, sink);
+		for (const auto& t : dfa.transitions) {
+			if (t.input == 0) continue; // epsilon
+			for (int c = bc.classOf[t.input.from]; c <= bc.classOf[t.input.to]; c++)
+				delta[(size_t)t.from * C + c] = (int)t.to;
+		}
+		// inverse transitions by class: pre[c] lists states of prebegin[c][t]..prebegin[c][t+1] go to t
+		std::vector<std::vector<int>> prebegin(C, std::vector<int>(n + 1, 0)), pre(C, std::vector<int>(n));
+		for (int c = 0; c < C; c++) {
+			auto& b = prebegin[c];
+			for (int s = 0; s < n; s++) b[delta[(size_t)s * C + c] + 1]++;
+			for (int t = 0; t < n; t++) b[t + 1] += b[t];
+			std::vector<int> fill(b.begin(), b.end() - 1);
+			for (int s = 0; s < n; s++) pre[c][fill[delta[(size_t)s * C + c]]++] = s;
+		}
+
+		// partition: elems[first[b]..last[b]) are states in block b, where[s] is position of s in elems
+		std::vector<int> elems(n), where(n), blockOf(n), first, last, marked;
+		// first division: sink alone, nonfinal states, final states grouped by token kind
+		std::map<std::string, int> kindBlock;
+		std::vector<std::vector<int>> groups(2);
+		groups[0].push_back(sink);
+		for (int i = 0; i < sink; i++) {
+			if (!origin[i].finalState)
+				groups[1].push_back(i);
+			else {
+				auto it = kindBlock.find(origin[i].is);
+				if (it == kindBlock.end()) {
+					it = kindBlock.emplace(origin[i].is, (int)groups.size()).first;
+					groups.emplace_back();
 				}
+				groups[it->second].push_back(i);
 			}
-		};
-		// tell if two state is equal
-		auto isEqual = [&dfa, &classified, getSetno](state* s1, state* s2) {
-			std::map<unsigned char, int> setno1, setno2;
-			for (const auto& i : dfa.inputs) { // init destination map
-				setno1[i] = -1;
-				setno2[i] = -1;
-			}
-			for (const auto& t : s1->trans) {
-				setno1[t->input] = getSetno(t->to);
-			}
-			for (const auto& t : s2->trans) {
-				setno2[t->input] = getSetno(t->to);
+		}
+		int pos = 0;
+		for (const auto& g : groups) {
+			if (g.empty()) continue;
+			first.push_back(pos);
+			for (int s : g) {
+				where[s] = pos;
+				elems[pos++] = s;
+				blockOf[s] = (int)first.size() - 1;
 			}
-			return setno1 == setno2;
+			last.push_back(pos);
+			marked.push_back(0);
+		}
+
+		// worklist of splitters (block, class)
+		std::vector<std::pair<int, int>> work;
+		std::vector<char> inWork;
+		auto addWork = [&](int b, int c) {
+			if ((size_t)(b + 1) * C > inWork.size()) inWork.resize((size_t)(b + 1) * C, 0);
+			if (inWork[(size_t)b * C + c]) return;
+			inWork[(size_t)b * C + c] = 1;
+			work.emplace_back(b, c);
 		};
-		// divide a group of states not equal to the first state in current set
-		auto divide = [&classified, isEqual](std::set<state*>& s) {
-			if (s.size() < 2) return false; // won't divide this turn
-			auto f = *(s.begin()); // first state in set
-			std::set<state*> nef; // not equal to the first state in set
-			for (auto i = s.begin(); i != s.end(); ++i) {
-				if (i == s.begin()) continue;
-				else {
-					if (!isEqual(f, *i)) { // not equal to first state
-						nef.insert(*i);
-					}
-				}
+		for (int b = 0; b < (int)first.size(); b++)
+			for (int c = 1; c < C; c++) addWork(b, c); // class 0 is epsilon, never moves
+
+		std::vector<int> splitter, touched;
+		while (!work.empty()) {
+			auto [sb, c] = work.back(); work.pop_back();
+			inWork[(size_t)sb * C + c] = 0;
+
+			// states move into splitter block by class c
+			splitter.clear();
+			for (int i = first[sb]; i < last[sb]; i++) {
+				int t = elems[i];
+				for (int j = prebegin[c][t]; j < prebegin[c][t + 1]; j++)
+					splitter.push_back(pre[c][j]);
 			}
-			for (const auto& nes : nef) {
-				s.erase(nes); // remove divided state
+			// mark them, moving marked states to the front of their block
+			touched.clear();
+			for (int s : splitter) {
+				int b = blockOf[s];
+				int p = first[b] + marked[b];
+				if (where[s] < p) continue; // already marked
+				if (marked[b] == 0) touched.push_back(b);
+				int o = elems[p];
+				std::swap(elems[where[s]], elems[p]);
+				where[o] = where[s];
+				where[s] = p;
+				marked[b]++;
 			}
-			if (nef.size() > 0)
-			{
-				classified.emplace_back(nef); // push new set
-				return true;
-			}
-			else return false;
-		};
-		// first division
-		std::set<state*> t1, t2;
-		for (const auto& s : dfa.states) { // divide final state with nonfinal
-			if (s->finalState)
-				t2.insert(s.Obj());
-			else
-				t1.insert(s.Obj());
-		}
-		classified.emplace_back(t1); t1.clear();
-		classified.emplace_back(t2); t2.clear();
+			// split touched blocks into marked and unmarked parts
+			for (int b : touched) {
+				int m = marked[b];
+				marked[b] = 0;
+				if (m == last[b] - first[b]) continue; // all moved in, no split
+				int nb = (int)first.size(); // marked part becomes new block
+				first.push_back(first[b]);
+				last.push_back(first[b] + m);
+				marked.push_back(0);
+				first[b] += m;
+				for (int i = first[nb]; i < last[nb]; i++) blockOf[elems[i]] = nb;
 
-		bool divided = true;
-		while (divided) // if last turn divided new set, do another turn
-		{
-			divided = false;
-			for (size_t i = 0; i < classified.size(); i++) // for each group
-			{
-				divided |= divide(classified[i]); // if divided
+				int smaller = (last[nb] - first[nb] <= last[b] - first[b]) ? nb : b;
+				for (int cc = 1; cc < C; cc++) {
+					if ((size_t)(b + 1) * C <= inWork.size() && inWork[(size_t)b * C + cc])
+						addWork(nb, cc); // old block waiting, both parts wait
+					else
+						addWork(smaller, cc); // the smaller part is enough
+				}
 			}
 		}
 
-		std::map<std::set<state*>, state*> dfa_ss_to_min_s;
-		for (const auto& s : classified) { // generate a map from states to minimized state
-			dfa_ss_to_min_s.emplace(s, mindfa.NewState()); 
-			if ((*s.begin())->finalState) { // update final state record
-				dfa_ss_to_min_s[s]->finalState = true;
-				dfa_ss_to_min_s[s]->is = (*s.begin())->is;
-			}
-			if (s.find(dfa.startState) != s.end()) { // set start state
-				mindfa.startState = dfa_ss_to_min_s[s];
+		// build minimized dfa, one state per block except the sink
+		const int sinkBlock = blockOf[sink];
+		std::vector<uint32_t> minstate(first.size(), NOSTATE);
+		for (int b = 0; b < (int)first.size(); b++) {
+			if (b == sinkBlock) continue;
+			minstate[b] = mindfa.NewState();
+			const auto& r = origin[elems[first[b]]]; // representative
+			if (r.finalState) { // update final state record
+				mindfa.states[minstate[b]].finalState = true;
+				mindfa.states[minstate[b]].is = r.is;
 			}
 		}
-		for (const auto& s : dfa_ss_to_min_s) { // generate new transitions
-			for (const auto& t : (*s.first.begin())->trans) { // transitions of a group of state
-				std::string tis = "";
-				if (t->to->finalState)
-					tis = t->to->is;
-				mindfa.NewTransition(s.second, dfa_ss_to_min_s[classified[getSetno(t->to)]], t->input, tis);
+		mindfa.startState = minstate[blockOf[dfa.startState]];
+		for (int b = 0; b < (int)first.size(); b++) {
+			if (b == sinkBlock) continue;
+			int r = elems[first[b]];
+			for (int c = 1; c < C;) { // merge adjacent classes with the same destination into one range
+				int tb = blockOf[delta[(size_t)r * C + c]];
+				int e = c;
+				while (e + 1 < C && blockOf[delta[(size_t)r * C + e + 1]] == tb) e++;
+				if (tb != sinkBlock)
+					mindfa.NewTransition(minstate[b], minstate[tb], CharRange(bc.ranges[c].from, bc.ranges[e].to));
+				c = e + 1;
 			}
 		}
+		mindfa.classes = dfa.classes;
 		return std::move(mindfa);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,190 @@
+#pragma once
+#include<vector>
+#include<string>
+#include<algorithm>
+#include<unordered_map>
+
+#include"LexFileLoader.h"
+#include"RegExpParser.h"
+#include"RegexAst.h"
+#include"Automaton.h"
+#include"DFA.h"
+
+namespace hscp {
+	// build dfa from regex syntax trees directly by followpos, no epsilon nfa involved
+	class DirectDFA {
+	private:
+		// a position is a leaf of the tree, or the end marker of a rule
+		struct position {
+			CharRange chr; // input of leaf
+			int rule; // rule index for end marker, -1 for leaf
+		};
+		// attributes of a tree node
+		struct nodeinfo {
+			bool nullable;
+			std::vector<int> firstpos, lastpos;
+		};
+		RegexTree tree; // all rules, alternated
+		std::vector<position> positions;
+		std::vector<int> posOf; // position of each leaf node, -1 for other nodes
+		std::vector<StateSet> followpos;
+		std::vector<int> startpos; // firstpos of the whole tree
+		std::vector<std::string> rules; // lexical meaning of each rule, earlier ones have priority
+		Automaton dfa;
+		std::unordered_map<StateSet, uint32_t, StateSetHash> positions_to_dfa_s; // map positions to dfa state
+		std::vector<std::pair<StateSet, uint32_t>> work; // dfa states not visited yet
+		ByteClasses classes;
+
+		// join a rule to the tree as (regex)#rule
+		void addRule(const RegexTree& t, const std::string& is) {
+			int offset = (int)tree.nodes.size();
+			for (auto n : t.nodes) { // copy nodes
+				if (n.left != -1) n.left += offset;
+				if (n.right != -1) n.right += offset;
+				tree.nodes.push_back(n);
+				posOf.push_back(-1);
+			}
+			// end marker of the rule
+			int end = tree.NewNode(RegexNode::Leaf);
+			posOf.push_back(newPosition(0, (int)rules.size()));
+			int r = tree.NewNode(RegexNode::Concat, t.root + offset, end);
+			posOf.push_back(-1);
+			rules.push_back(is);
+
+			if (tree.root == -1)
+				tree.root = r;
+			else {
+				tree.root = tree.NewNode(RegexNode::Alter, tree.root, r);
+				posOf.push_back(-1);
+			}
+		}
+		int newPosition(CharRange chr, int rule) {
+			positions.push_back({ chr, rule });
+			return (int)positions.size() - 1;
+		}
+		// number leaves as positions
+		void numberPositions() {
+			for (size_t i = 0; i < tree.nodes.size(); i++) {
+				if (tree.nodes[i].type == RegexNode::Leaf && posOf[i] == -1)
+					posOf[i] = newPosition(tree.nodes[i].chr, -1);
+			}
+		}
+		// compute nullable, firstpos, lastpos bottom-up and followpos
+		void computeFollowpos() {
+			auto join = [](const std::vector<int>& a, const std::vector<int>& b) {
+				std::vector<int> r;
+				std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(r));
+				return r;
+			};
+			auto follow = [this](const std::vector<int>& from, const std::vector<int>& to) {
+				for (int p : from)
+					for (int q : to) followpos[p].Insert(q);
+			};
+			followpos.assign(positions.size(), StateSet(positions.size()));
+			std::vector<nodeinfo> info(tree.nodes.size());
+			for (size_t i = 0; i < tree.nodes.size(); i++) { // children come before parents
+				const auto& n = tree.nodes[i];
+				auto& f = info[i];
+				switch (n.type)
+				{
+				case RegexNode::Leaf:
+					f = { false, { posOf[i] }, { posOf[i] } };
+					break;
+				case RegexNode::Concat: {
+					const auto& l = info[n.left], & r = info[n.right];
+					f.nullable = l.nullable && r.nullable;
+					f.firstpos = l.nullable ? join(l.firstpos, r.firstpos) : l.firstpos;
+					f.lastpos = r.nullable ? join(l.lastpos, r.lastpos) : r.lastpos;
+					follow(l.lastpos, r.firstpos);
+					break;
+				}
+				case RegexNode::Alter: {
+					const auto& l = info[n.left], & r = info[n.right];
+					f.nullable = l.nullable || r.nullable;
+					f.firstpos = join(l.firstpos, r.firstpos);
+					f.lastpos = join(l.lastpos, r.lastpos);
+					break;
+				}
+				case RegexNode::Star:
+				case RegexNode::Plus:
+				case RegexNode::Optional: {
+					const auto& l = info[n.left];
+					f.nullable = n.type == RegexNode::Plus ? l.nullable : true;
+					f.firstpos = l.firstpos;
+					f.lastpos = l.lastpos;
+					if (n.type != RegexNode::Optional)
+						follow(l.lastpos, l.firstpos); // loop back
+					break;
+				}
+				case RegexNode::Repeat: // RegexAst expands repeats to copies before the tree is made
+					throw std::exception("repetition is expanded by RegexAst");
+				}
+			}
+			startpos = info[tree.root].firstpos;
+		}
+		// get dfa state of a set of positions, created if new
+		uint32_t getState(StateSet&& ss) {
+			ss.Rehash();
+			auto it = positions_to_dfa_s.find(ss);
+			if (it != positions_to_dfa_s.end()) return it->second;
+
+			uint32_t n = dfa.NewState();
+			// an end marker makes the state final, the rule defined first wins
+			int win = -1;
+			ss.ForEach([this, &win](int p) {
+				int r = positions[p].rule;
+				if (r != -1 && (win == -1 || r < win)) win = r;
+				});
+			if (win != -1) {
+				dfa.states[n].finalState = true;
+				dfa.states[n].is = rules[win];
+			}
+			positions_to_dfa_s.emplace(ss, n);
+			work.emplace_back(std::move(ss), n); // not visited yet
+			return n;
+		}
+		// construct states from start positions
+		void dfaConverter() {
+			std::vector<CharRange> inputs;
+			for (const auto& p : positions)
+				if (p.rule == -1) inputs.push_back(p.chr);
+			classes = ByteClasses::Split(inputs);
+
+			StateSet t(positions.size());
+			for (int p : startpos) t.Insert(p);
+			dfa.startState = getState(std::move(t)); // getting initial state
+
+			while (!work.empty()) // get state left
+			{
+				auto [ss, from] = std::move(work.back()); work.pop_back(); // now this set is visited
+				for (size_t c = 1; c < classes.Count(); c++) { // for each input class (but epsilon)
+					unsigned char input = classes.ranges[c].from; // any byte in the class works
+					StateSet t2(positions.size());
+					ss.ForEach([this, &t2, input](int p) {
+						const auto& pos = positions[p];
+						if (pos.rule == -1 && pos.chr.from <= input && pos.chr.to >= input)
+							t2.Union(followpos[p]);
+						});
+					if (t2.Empty()) continue;
+
+					dfa.NewTransition(from, getState(std::move(t2)), classes.ranges[c]);
+				}
+			}
+			dfa.classes = classes;
+		}
+		DirectDFA(const std::vector<token_define>& defs) {
+			for (const auto& d : defs) // for each expression
+				addRule(d.ast ? d.ast->ToTree() : RegexAst::Parse(d.expr).ToTree(), d.id);
+			if (tree.root == -1) return; // no rules
+
+			numberPositions();
+			computeFollowpos();
+			dfaConverter();
+		}
+	public:
+		// build a dfa recognizing all rules, rule defined first has priority
+		static Automaton Regex2Dfa(const std::vector<token_define>& defs) {
+			return std::move(DirectDFA(defs).dfa);
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+#include<string>
+#include<string_view>
+#include<deque>
+#include<unordered_map>
+#include<cstdint>
+
+namespace hscp {
+	// interned strings, each distinct string gets a small id in order of appearance
+	class Interner {
+	private:
+		std::deque<std::string> strings; // deque never moves its items, so views in ids stay valid
+		std::unordered_map<std::string_view, uint32_t> ids;
+	public:
+		Interner() = default;
+		Interner(Interner&&) = default; // strings stay in place when moved
+		Interner(const Interner&) = delete; // views would refer to the copied one
+		Interner& operator=(const Interner&) = delete;
+		// id of a string, added if new
+		uint32_t Id(std::string_view s) {
+			auto it = ids.find(s);
+			if (it != ids.end()) return it->second;
+			uint32_t id = (uint32_t)strings.size();
+			strings.emplace_back(s);
+			ids.emplace(strings.back(), id);
+			return id;
+		}
+		// string of an id
+		const std::string& Get(uint32_t id) const {
+			return strings[id];
+		}
+		size_t Size() const {
+			return strings.size();
+		}
+	};
+	// names of token kinds and grammar symbols, shared by lexer and parser
+	inline Interner& Symbols() {
+		static Interner symbols;
+		return symbols;
+	}
+	// spellings of identifiers read from sources
+	inline Interner& Spellings() {
+		static Interner spellings;
+		return spellings;
+	}
+}
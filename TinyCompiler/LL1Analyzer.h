@@ -31,8 +31,8 @@ namespace hscp {
 			ana.push_back(GRAMMAR_START_SYMBOL);
 			PrintStack(ana);
 			for (auto i = tokenstream.begin(); i != tokenstream.end();) {
-				if (ana.back() == ('^' + i->is)) {
-					if (i->is == "#")
+				if (ana.back() == ('^' + i->Is())) {
+					if (i->Is() == "#")
 						break;
 					else {
 						ana.pop_back();
@@ -40,10 +40,10 @@ namespace hscp {
 						++i;
 					}
 				}else
-				if (table.at(ana.back()).find('^' + i->is) != table.at(ana.back()).end()) {
+				if (table.at(ana.back()).find('^' + i->Is()) != table.at(ana.back()).end()) {
 					auto S = ana.back();
 					ana.pop_back();
-					for (auto j = table.at(S).at('^' + i->is).rbegin(); j != table.at(S).at('^' + i->is).rend(); ++j)
+					for (auto j = table.at(S).at('^' + i->Is()).rbegin(); j != table.at(S).at('^' + i->Is()).rend(); ++j)
 					{
 						if (*j != "^Epsilon")
 						{
@@ -56,7 +56,6 @@ namespace hscp {
 				}
 				else {
 					errors.push_back(*i);
-					errors.back().type = "Err";
 					++i;
 				}
 			}
@@ -70,7 +69,7 @@ namespace hscp {
 				std::cout << "No Err Detected.\n";
 			}
 			for (const auto& e : errors) {
-				std::cout << "Error: " << e.content << " (" << e.is << ") " << "at line: " << e.line << " ,column: " << e.column << ".\n";
+				std::cout << "Error: " << e.Content() << " (" << e.Is() << ") " << "at line: " << e.Line() << " ,column: " << e.Column() << ".\n";
 			}
 		}
 	};
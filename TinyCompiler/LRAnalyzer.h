@@ -7,7 +7,7 @@ namespace {
 	void PrintStack(const std::deque<hscp::Token>& st) {
 
 		for (const auto& t : st) {
-			std::cout << t.is << ' ';
+			std::cout << t.Is() << ' ';
 		}
 		std::cout << '\n';
 	}
@@ -54,10 +54,29 @@ namespace hscp {
 	private:
 		const std::map<TState*, std::map<std::string, LROperation<TState>>>& table;
 		const std::vector<std::pair<std::string, std::list<std::string>>>& productions;
-		const std::vector<Token>& tokenstream;
 
 		AnalyzeTree tree;
 		std::vector<Token> errors;
+		std::vector<SourceRef> sources; // held for tokens in the tree and errors
+		std::map<TState*, std::vector<const LROperation<TState>*>> actions; // operations of each state indexed by token kind
+
+		// index operations on terminals by symbol id, so tokens are looked up without strings
+		void indexActions() {
+			for (const auto& [state, ops] : table) {
+				auto& row = actions[state];
+				for (const auto& [symbol, op] : ops) {
+					if (symbol[0] != '^') continue; // not a terminal
+					auto kind = Symbols().Id(symbol.substr(1));
+					if (kind >= row.size()) row.resize(kind + 1, nullptr);
+					row[kind] = &op;
+				}
+			}
+		}
+		// operation of a state on a token, nullptr if it can't move
+		const LROperation<TState>* action(TState* state, const Token& token) const {
+			const auto& row = actions.at(state);
+			return token.kind < row.size() ? row[token.kind] : nullptr;
+		}
 	public:
 		/*Analyzer(const LR0Automaton& at, const std::map<TState*, std::map<std::string, LROperation<TState>>>& table, const std::vector<Token>& tokenstream) :table(table), productions(at.productions), tokenstream(tokenstream) {
 			std::deque<Token> symbol;
@@ -99,37 +118,41 @@ namespace hscp {
 				}
 			}
 		}*/
-
-		// analyze and gete analyze tree
-		Analyzer(const LR1Automaton& at, const std::map<TState*, std::map<std::string, LROperation<TState>>>& table, const std::vector<Token>& tokenstream) :table(table), productions(at.productions), tokenstream(tokenstream) {
+	private:
+		// analyze tokens read one by one from next(token), which returns false when there's no more
+		template<typename Next>
+		void analyze(const LR1Automaton& at, Next next) {
 			std::deque<Token> symbol_stack;
 			std::deque<TState*> state;
 			std::deque<AnalyzeTreeNode*> syntax;
 
 			state.push_back(at.states[0].Obj()); // push start state
+			indexActions();
 			AnalyzeTreeNode* snode = nullptr;
-			for (auto i = tokenstream.begin(); i != tokenstream.end();) { // read token
+			Token i;
+			for (bool more = next(i); more;) { // read token
 				auto it = find(state.back()->trans.begin(), state.back()->trans.end(), (void*)0);
 				int pn;
-				if (table.at(state.back()).find('^' + i->is) == table.at(state.back()).end()) { // cannot move, ignore this token
-					errors.push_back(*i);
-					i++;
+				auto op = action(state.back(), i);
+				if (op == nullptr) { // cannot move, ignore this token
+					errors.push_back(i);
+					more = next(i);
 					continue;
 				}
-				switch (table.at(state.back()).at('^' + i->is).OpType) // can move
+				switch (op->OpType) // can move
 				{
 				case LROperation<TState>::ACC:
 					tree.root = syntax.back(); // accept, move the tree
 					return;
 				case LROperation<TState>::S: // shift to state
-					state.push_back(table.at(state.back()).at('^' + i->is).sid);
-					symbol_stack.push_back(*i);
-					syntax.push_back(new AnalyzeTreeNode{ *i, i->is, {} });
-					++i;
+					state.push_back(op->sid);
+					symbol_stack.push_back(i);
+					syntax.push_back(new AnalyzeTreeNode{ i, i.Is(), {} });
+					more = next(i);
 					PrintStack(symbol_stack);
 					break;
 				case LROperation<TState>::R: // reduce
-					pn = table.at(state.back()).at('^' + i->is).pid; // [actually GOTO is here]
+					pn = op->pid; // [actually GOTO is here]
 					snode = new AnalyzeTreeNode{ {},productions[pn].first,{} }; // this parent node
 					for (int n = 0; n < productions[pn].second.size(); n++) {
 						snode->children.push_front(syntax.back()); // add children node
@@ -139,7 +162,7 @@ namespace hscp {
 					}
 					it = find_if(state.back()->trans.begin(), state.back()->trans.end(), [t = productions[pn]](auto e){return e->symbol == t.first; });
 					state.push_back((*it)->to);
-					symbol_stack.push_back({ "", productions[pn].first });
+					symbol_stack.push_back({ (uint16_t)Symbols().Id(productions[pn].first),0,0,0,Token::NOSPELLING }); // nonterminal on stack, no contents
 					syntax.push_back(snode);
 					PrintStack(symbol_stack);
 					break;
@@ -151,6 +174,20 @@ namespace hscp {
 
 			tree.root = syntax.back(); // won't be executed in normal case
 		}
+	public:
+		// analyze and gete analyze tree
+		Analyzer(const LR1Automaton& at, const std::map<TState*, std::map<std::string, LROperation<TState>>>& table, const TokenList& tokenstream) :table(table), productions(at.productions), sources(tokenstream.sources) {
+			size_t n = 0;
+			analyze(at, [&tokenstream, &n](Token& t) {
+				if (n == tokenstream.size()) return false;
+				t = tokenstream[n++];
+				return true;
+				});
+		}
+		// analyze tokens pulled from a stream while parsing, the lexer is only ahead by one token
+		Analyzer(const LR1Automaton& at, const std::map<TState*, std::map<std::string, LROperation<TState>>>& table, Matcher::TokenStream& tokens) :table(table), productions(at.productions), sources{ tokens.Source() } {
+			analyze(at, [&tokens](Token& t) { return tokens.Next(t); });
+		}
 		std::vector<Token>& GetErrors() {
 			return errors;
 		}
@@ -159,7 +196,7 @@ namespace hscp {
 				std::cout << "No Err Detected.\n";
 			}
 			for (const auto& e : errors) {
-				std::cout << "Error: " << e.content << " (" << e.is << ") " << "at line: " << e.line << " ,column: " << e.column << ".\n";
+				std::cout << "Error: " << e.Content() << " (" << e.Is() << ") " << "at line: " << e.Line() << " ,column: " << e.Column() << ".\n";
 			}
 		}
 
@@ -0,0 +1,265 @@
+#pragma once
+#include<vector>
+#include<string>
+#include<array>
+#include<unordered_map>
+#include<memory>
+#include<algorithm>
+#include<cstdint>
+
+#include"Automaton.h"
+
+namespace hscp {
+	// lexer dfa made on demand from the merged nfa of all rules, a state is made when scanning first reaches it
+	// so nothing is determinized before the first token, and a spec whose full dfa is huge only pays for states it uses
+	// states live in a bounded cache which is flushed when full, when flushes come too often the nfa is simulated instead
+	// a lexer with modes has the nfa of each mode side by side, each from its own start
+	class LazyDFA {
+	public:
+		static constexpr int32_t DEAD = -1; // no state, the token ends
+		static constexpr int NONE = -1; // accepting no token
+	private:
+		static constexpr int32_t UNKNOWN = -2; // transition not made yet
+		static constexpr size_t THRASH = 16; // steps per state made between flushes, fewer means the cache doesn't pay
+		static constexpr size_t STATECOST = 96; // bytes taken by a cached state besides its row and set
+		// the nfa, never changed and shared by copies
+		struct nfaPart {
+			std::array<unsigned char, 256> classOf{};
+			uint32_t classCount = 0;
+			struct move {
+				uint32_t from, to; // classes [from, to] go to target
+				int target;
+			};
+			std::vector<std::vector<move>> moves; // of each nfa state
+			std::vector<std::vector<int>> epsilons; // of each nfa state
+			std::vector<int> kindOf; // token id of each final state, NONE for others
+			std::vector<std::string> kinds; // token id to its lexical meaning
+			std::vector<int> starts; // of each mode, -1 if it has no rules
+			std::vector<std::string> modes; // names of modes, empty if one
+		};
+		// hash of a sorted set of nfa states
+		struct setHash {
+			size_t operator()(const std::vector<int>& s) const {
+				size_t h = s.size();
+				for (int v : s) h ^= (size_t)v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+				return h;
+			}
+		};
+		std::shared_ptr<const nfaPart> nfa;
+		const unsigned char* classOf; // of nfa, kept here for the hot path
+		uint32_t classCount;
+
+		// cache of states
+		size_t budget; // bytes the cache may take
+		size_t used = 0;
+		std::vector<std::vector<int>> sets; // nfa states of each dfa state, sorted
+		std::vector<int32_t> next; // next[state * classCount + class], UNKNOWN if not made yet
+		std::vector<int> accept; // token id of each dfa state
+		std::unordered_map<std::vector<int>, int32_t, setHash> ids; // dfa state of a set
+		std::vector<int32_t> starts; // of each mode, made again after a flush
+		size_t steps = 0; // since the last flush
+		size_t flushes = 0;
+		bool simulating = false; // states are not cached any more, the nfa is stepped directly
+
+		// e-closure of each nfa state, made when first needed
+		std::vector<std::vector<int>> closures;
+		std::vector<char> closed;
+		std::vector<int> seen; // nfa states passed making a closure are marked by the state it is made for, plus one
+		// scratch of a step
+		std::vector<uint32_t> mark; // nfa states added in this step have the stamp
+		uint32_t stamp = 0;
+		std::vector<int> stack, out;
+
+		void newStamp() {
+			if (++stamp == 0) { // wrapped, old marks could match
+				std::fill(mark.begin(), mark.end(), 0);
+				stamp = 1;
+			}
+		}
+		// e-closure of a nfa state, only states moving by some input or final are kept,
+		// others add nothing to a step, and sets of them are smaller and alike more often
+		const std::vector<int>& closureOf(int s) {
+			auto& cl = closures[s];
+			if (closed[s]) return cl;
+			closed[s] = true;
+			seen[s] = s + 1;
+			stack.push_back(s);
+			while (!stack.empty()) {
+				int c = stack.back(); stack.pop_back();
+				if (!nfa->moves[c].empty() || nfa->kindOf[c] != NONE) cl.push_back(c);
+				for (int e : nfa->epsilons[c])
+					if (seen[e] != s + 1) {
+						seen[e] = s + 1;
+						stack.push_back(e);
+					}
+			}
+			return cl;
+		}
+		// add e-closure of a nfa state to out, states marked are in already
+		void addClosure(int s) {
+			for (int c : closureOf(s))
+				if (mark[c] != stamp) {
+					mark[c] = stamp;
+					out.push_back(c);
+				}
+		}
+		// nfa states reached from a set by a class to out, sorted as a key of cache
+		void step(const std::vector<int>& from, uint32_t c) {
+			newStamp();
+			out.clear();
+			for (int s : from)
+				for (const auto& m : nfa->moves[s])
+					if (m.from <= c && c <= m.to) addClosure(m.target);
+			if (!simulating) std::sort(out.begin(), out.end());
+		}
+		// token id accepted by a set, the rule defined first wins as its states come first
+		int acceptOf(const std::vector<int>& set) const {
+			int win = -1;
+			for (int s : set)
+				if (nfa->kindOf[s] != NONE && (win == -1 || s < win)) win = s;
+			return win == -1 ? NONE : nfa->kindOf[win];
+		}
+		// drop all states, or give up caching if the states made were hardly used
+		void flush() {
+			if (steps < THRASH * sets.size()) simulating = true;
+			sets.clear();
+			next.clear();
+			accept.clear();
+			ids.clear();
+			starts.assign(starts.size(), DEAD);
+			used = 0;
+			steps = 0;
+			flushes++;
+			if (simulating) { // starts and two working states: the current one and the one it moves to
+				sets.resize(starts.size() + 2);
+				accept.resize(starts.size() + 2, NONE);
+			}
+		}
+		// state of the set in out, made if new; slot is the working state used when simulating
+		int32_t stateOf(int32_t slot) {
+			if (out.empty()) return DEAD;
+			size_t cost = STATECOST + classCount * sizeof(int32_t) + out.size() * sizeof(int) * 2; // set is kept in sets and ids
+			if (!simulating) {
+				auto it = ids.find(out);
+				if (it != ids.end()) return it->second;
+				if (used + cost > budget && !sets.empty()) flush();
+			}
+			if (simulating) {
+				sets[slot].swap(out); // out is cleared by the next step
+				accept[slot] = acceptOf(sets[slot]);
+				return slot;
+			}
+			int32_t s = (int32_t)sets.size();
+			sets.push_back(out);
+			accept.push_back(acceptOf(out));
+			next.resize(next.size() + classCount, UNKNOWN);
+			ids.emplace(out, s);
+			used += cost;
+			return s;
+		}
+		// make a transition not in cache
+		int32_t slowNext(int32_t s, unsigned char ch) {
+			uint32_t c = classOf[ch];
+			step(sets[s], c);
+			int32_t work = (int32_t)starts.size(); // first working state
+			if (simulating) return stateOf(s == work ? work + 1 : work); // the other working state
+			size_t before = flushes;
+			int32_t to = stateOf(work);
+			if (flushes == before) // s is gone after a flush
+				next[(size_t)s * classCount + c] = to;
+			return to;
+		}
+	public:
+		// nfa merged from rules in order of priority (see BuildNfa), budget bounds bytes taken by cached states
+		LazyDFA(const Automaton& merged, size_t budget = 16 << 20) :budget(budget) {
+			init(merged, { merged.startState == NOSTATE ? -1 : (int)merged.startState }, {});
+		}
+		// merged nfa of each mode, named by modes (the initial one first)
+		LazyDFA(const std::vector<Automaton>& merged, const std::vector<std::string>& modes, size_t budget = 16 << 20) :budget(budget) {
+			Automaton all;
+			std::vector<int> starts;
+			for (const auto& m : merged) {
+				uint32_t offset = all.Splice(m);
+				starts.push_back(m.startState == NOSTATE ? -1 : (int)(m.startState + offset));
+			}
+			init(all, starts, modes);
+		}
+	private:
+		void init(const Automaton& merged, const std::vector<int>& nfaStarts, const std::vector<std::string>& modes) {
+			auto part = std::make_shared<nfaPart>();
+			auto bc = ByteClasses::Split(merged.transitions);
+			part->classOf = bc.classOf;
+			part->classCount = (uint32_t)bc.Count();
+			part->moves.resize(merged.states.size());
+			part->epsilons.resize(merged.states.size());
+			for (const auto& t : merged.transitions) {
+				if (t.input == 0) part->epsilons[t.from].push_back((int)t.to);
+				else part->moves[t.from].push_back({ bc.classOf[t.input.from], bc.classOf[t.input.to], (int)t.to });
+			}
+			part->kindOf.assign(merged.states.size(), NONE);
+			for (size_t s = 0; s < merged.states.size(); s++) {
+				if (!merged.states[s].finalState) continue;
+				auto it = std::find(part->kinds.begin(), part->kinds.end(), merged.states[s].is);
+				part->kindOf[s] = (int)(it - part->kinds.begin());
+				if (it == part->kinds.end()) part->kinds.push_back(merged.states[s].is);
+			}
+			part->starts = nfaStarts;
+			part->modes = modes;
+			nfa = std::move(part);
+			starts.assign(nfaStarts.size(), DEAD);
+			classOf = nfa->classOf.data();
+			classCount = nfa->classCount;
+			mark.assign(merged.states.size(), 0);
+			closures.resize(merged.states.size());
+			closed.assign(merged.states.size(), false);
+			seen.assign(merged.states.size(), 0);
+		}
+	public:
+		// start state of a mode, DEAD if the mode accepts nothing
+		int32_t Start(int mode = 0) {
+			if (starts[mode] == DEAD && nfa->starts[mode] != -1) {
+				newStamp();
+				out.clear();
+				addClosure(nfa->starts[mode]);
+				if (!simulating) std::sort(out.begin(), out.end());
+				starts[mode] = stateOf(mode);
+			}
+			return starts[mode];
+		}
+		// move from state s by a byte
+		int32_t Next(int32_t s, unsigned char ch) {
+			steps++;
+			if (!simulating) {
+				int32_t to = next[(size_t)s * classCount + classOf[ch]];
+				if (to != UNKNOWN) return to;
+			}
+			return slowNext(s, ch);
+		}
+		// token id accepted by state s, NONE if not final
+		int Accept(int32_t s) const {
+			return accept[s];
+		}
+		// token id to its lexical meaning
+		const std::vector<std::string>& Kinds() const {
+			return nfa->kinds;
+		}
+		// names of modes, the initial one first; empty if one mode
+		const std::vector<std::string>& Modes() const {
+			return nfa->modes;
+		}
+		// states in cache
+		size_t States() const {
+			return simulating ? 0 : sets.size();
+		}
+		// bytes taken by states in cache
+		size_t Used() const {
+			return used;
+		}
+		size_t Flushes() const {
+			return flushes;
+		}
+		bool Simulating() const {
+			return simulating;
+		}
+	};
+}
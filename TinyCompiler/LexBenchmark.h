@@ -0,0 +1,439 @@
+#pragma once
+#include<vector>
+#include<string>
+#include<set>
+#include<chrono>
+#include<random>
+#include<iostream>
+#include<iomanip>
+#include<thread>
+#include<algorithm>
+#include<fstream>
+#include<filesystem>
+
+#include"LexFileLoader.h"
+#include"Automaton.h"
+#include"DFA.h"
+#include"LexBuilder.h"
+#include"LexMatcher.h"
+#include"LazyDFA.h"
+#include"ByteScan.h"
+
+namespace hscp {
+	namespace {
+		// milliseconds passed since a time point
+		double elapsedMs(std::chrono::steady_clock::time_point from) {
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - from).count();
+		}
+	}
+	// synthetic lexical rules: n random keywords, then identifier and number
+	std::vector<token_define> KeywordRules(size_t n, unsigned seed = 1) {
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> len(3, 9), letter('a', 'z');
+		std::set<std::string> words;
+		std::vector<token_define> defs;
+		while (words.size() < n) {
+			std::string w(len(rng), 'a');
+			for (auto& ch : w) ch = (char)letter(rng);
+			if (words.insert(w).second)
+				defs.push_back({ title_type::reserve, w, w, (int)defs.size() + 1, false });
+		}
+		defs.push_back({ title_type::structure, "identifier", "[_a-zA-Z][_a-zA-Z0-9]*", (int)defs.size() + 1, false });
+		defs.push_back({ title_type::structure, "numberval", "[0-9]+(\\.[0-9]+)?", (int)defs.size() + 1, false });
+		return defs;
+	}
+	// time every step of lexer construction on specs with a few hundred keywords, then the direct builder as a whole,
+	// then the lexer with keywords split off the dfa to a hash
+	// fold is the old way to merge rules, one by one on a single thread, for comparison with rules + merge
+	void BenchKeywords(const std::vector<size_t>& sizes = { 100, 200, 400, 800 }) {
+		std::cout << std::left << std::setw(10) << "keywords" << std::setw(12) << "fold(ms)" << std::setw(12) << "rules(ms)" << std::setw(12) << "merge(ms)"
+			<< std::setw(12) << "nfa2dfa(ms)" << std::setw(13) << "minimize(ms)" << std::setw(12) << "direct(ms)" << std::setw(12) << "dfa states" << std::setw(12) << "min states"
+			<< std::setw(12) << "kwhash(ms)" << "kwhash states\n";
+		for (auto n : sizes) {
+			auto defs = KeywordRules(n);
+
+			auto t = std::chrono::steady_clock::now();
+			Automaton folded;
+			for (const auto& d : defs)
+				folded = Automaton::Merge(folded, BuildRule(d));
+			double fold = elapsedMs(t);
+
+			t = std::chrono::steady_clock::now();
+			auto rules = BuildRules(defs); // same steps as lexer construction in main
+			double rulesMs = elapsedMs(t);
+
+			t = std::chrono::steady_clock::now();
+			auto at = Automaton::Merge(rules);
+			double merge = elapsedMs(t);
+
+			t = std::chrono::steady_clock::now();
+			auto dfa = DFAConverter::Nfa2Dfa(at);
+			double convert = elapsedMs(t);
+
+			t = std::chrono::steady_clock::now();
+			auto mindfa = DFAminimizer(dfa);
+			double minimize = elapsedMs(t);
+
+			t = std::chrono::steady_clock::now();
+			auto direct = BuildLexer(defs, LexBuild::Direct);
+			double directMs = elapsedMs(t);
+			if (direct.states.size() != mindfa.states.size())
+				std::cout << "direct builder disagrees: " << direct.states.size() << " states\n";
+
+			t = std::chrono::steady_clock::now();
+			auto hashed = BuildTable(defs, LexBuild::Thompson, true);
+			double hashedMs = elapsedMs(t);
+
+			std::cout << std::left << std::setw(10) << n << std::setw(12) << fold << std::setw(12) << rulesMs << std::setw(12) << merge << std::setw(12) << convert
+				<< std::setw(13) << minimize << std::setw(12) << directMs << std::setw(12) << dfa.states.size() << std::setw(12) << mindfa.states.size()
+				<< std::setw(12) << hashedMs << hashed.stateCount << '\n';
+		}
+	}
+	// synthetic source of about size bytes, mostly indentation, blank lines and comments
+	std::string SpacedSource(size_t size, unsigned seed = 1) {
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> pick(0, 9), indent(0, 24), num(0, 99999);
+		std::string src;
+		while (src.size() < size) {
+			src.append(indent(rng), ' ');
+			switch (pick(rng))
+			{
+			case 0: case 1: case 2:
+				src += "// the line comment explains what the statement below does, in a few words\n";
+				break;
+			case 3:
+				src += "/* block comment\n\t\tover lines 123 - and more text */\n";
+				break;
+			case 4:
+				src += "\n\n\t\t\n";
+				break;
+			default:
+				src += "x" + std::to_string(num(rng)) + " := y + " + std::to_string(num(rng)) + " * (z - 3.25);\n";
+				break;
+			}
+		}
+		return src;
+	}
+	// synthetic source of about size bytes, mostly long identifiers (from a few hundred names) and numbers
+	std::string WordySource(size_t size, unsigned seed = 1) {
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> len(8, 32), letter('a', 'z'), digit('0', '9'), pick(0, 499);
+		auto word = [&](bool number) {
+			std::string w(len(rng), '_');
+			for (auto& ch : w) ch = (char)(number ? digit(rng) : letter(rng));
+			return w;
+		};
+		std::vector<std::string> names;
+		for (int i = 0; i < 500; i++) names.push_back(word(false));
+		std::string src;
+		while (src.size() < size)
+			src += names[pick(rng)] + " := " + names[pick(rng)] + " + " + word(true) + "." + word(true) + ";\n";
+		return src;
+	}
+	// lexer throughput on a source, with each level of ByteScan
+	void BenchScan(const LexTable& table, const std::string& title, const std::string& src) {
+		auto saved = ByteScan::Current();
+		const char* names[] = { "scalar", "sse2", "ssse3", "avx2" };
+		size_t expect = 0;
+		std::cout << std::left << std::setw(10) << title << std::setw(12) << "MB/s" << "tokens\n";
+		for (int lv = ByteScan::Scalar; lv <= ByteScan::AVX2; lv++) {
+			ByteScan::Use((ByteScan::Level)lv);
+			if (ByteScan::Current() != lv) break; // not supported by cpu
+			Matcher mc(table);
+			TokenList tokens;
+			double ms = 0;
+			for (int round = 0; round < 3; round++) { // best of rounds
+				auto t = std::chrono::steady_clock::now();
+				tokens = mc.Scan(src);
+				double r = elapsedMs(t);
+				if (round == 0 || r < ms) ms = r;
+			}
+			if (lv == ByteScan::Scalar) expect = tokens.size();
+			else if (tokens.size() != expect) std::cout << "token count disagrees with scalar\n";
+			std::cout << std::left << std::setw(10) << names[lv] << std::setw(12) << src.size() / 1048576.0 / (ms / 1000) << tokens.size() << '\n';
+		}
+		ByteScan::Use(saved);
+	}
+	// lexer throughput scanning a source by more and more threads, must give the same tokens as one
+	void BenchThreads(const LexTable& table, const std::string& src) {
+		unsigned most = std::max(4u, std::thread::hardware_concurrency());
+		Matcher mc(table);
+		TokenList expect;
+		std::cout << std::left << std::setw(10) << "threads" << std::setw(12) << "MB/s" << "tokens\n";
+		for (unsigned n = 1; n <= most; n *= 2) {
+			TokenList tokens;
+			double ms = 0;
+			for (int round = 0; round < 3; round++) { // best of rounds
+				auto t = std::chrono::steady_clock::now();
+				tokens = mc.Scan(src, n);
+				double r = elapsedMs(t);
+				if (round == 0 || r < ms) ms = r;
+			}
+			if (n == 1) expect = tokens;
+			else if (tokens.size() != expect.size() || !std::equal(tokens.begin(), tokens.end(), expect.begin(), [](const Token& a, const Token& b) {
+				return a.kind == b.kind && a.offset == b.offset && a.length == b.length && a.spelling == b.spelling;
+				}))
+				std::cout << "tokens differ from one thread\n";
+			std::cout << std::left << std::setw(10) << n << std::setw(12) << src.size() / 1048576.0 / (ms / 1000) << tokens.size() << '\n';
+		}
+	}
+	// check block comments of Data/lex-define.txt (read in the comment mode): a malformed or unterminated comment is an error
+	// and scanning goes on in the initial mode after it; also fed byte by byte, false if tokens are not as expected
+	bool CheckComments(Matcher& mc) {
+		struct sample {
+			std::string source;
+			std::vector<std::string> kinds; // names of tokens, delimiter left out
+		};
+		const std::vector<sample> samples = {
+			{ "/* ok */ q", { "comment", "identifier" } },
+			{ "/* x.y */ z", { "Err", "Err", "identifier", "*", "/", "identifier" } }, // '.' can't be in a comment
+			{ "a /* never closed\n x = 1;\nif b", { "identifier", "Err", "=", "numberval", ";", "if", "identifier" } },
+			{ "x /* to the end", { "identifier", "Err" } },
+			{ "/*", { "Err" } },
+		};
+		bool ok = true;
+		for (const auto& s : samples) {
+			auto tokens = mc.Scan(s.source);
+			TokenList fed;
+			Matcher::ChunkLexer lexer(mc);
+			for (char ch : s.source) lexer.Feed(std::string_view(&ch, 1), fed);
+			lexer.Finish(fed);
+			std::vector<std::string> kinds, fedKinds;
+			for (size_t i = 0; i + 1 < tokens.size(); i++) kinds.push_back(tokens[i].Is());
+			for (size_t i = 0; i + 1 < fed.size(); i++) fedKinds.push_back(fed[i].Is());
+			if (kinds != s.kinds || fedKinds != s.kinds) {
+				std::cout << "comment check failed on \"" << s.source << "\":";
+				for (const auto& k : kinds) std::cout << ' ' << k;
+				std::cout << '\n';
+				ok = false;
+			}
+		}
+		return ok;
+	}
+	// check repetition counts: large counts build, nested ones whose copies pass RegexAst::EXPAND_MAX are rejected
+	// rather than expanded; false if a rule is not as expected
+	bool CheckRepetitions() {
+		const std::vector<std::pair<std::string, bool>> samples = { // rule, built
+			{ "[0-9]{1000}", true }, { "(ab|a){2,500}", true }, { "(x{1,40}){1,40}", true }, { "((ab|cd){1,20}){1,20}", true },
+			{ "(x{1000}){1000}", false }, { "(x{1,300}){1,300}", false }, { "((ab|cd){1,50}){1,50}", false }, { "((x{10}){10}){10}{10}", false },
+		};
+		bool ok = true;
+		for (const auto& [expr, built] : samples) {
+			std::string error;
+			try {
+				BuildRule({ title_type::structure, "x", expr, 1, false });
+			}
+			catch (const std::exception& e) {
+				error = e.what();
+			}
+			if (built != error.empty() || (!built && error != "repetition count too large")) {
+				std::cout << "repetition check failed on " << expr << (error.empty() ? ": built" : ": " + error) << '\n';
+				ok = false;
+			}
+		}
+		return ok;
+	}
+	// rules whose full dfa has about 2^(k+1) states: a word of a and b whose k+1-th letter from the end is a, then any word
+	std::vector<token_define> TailRules(int k) {
+		std::string expr = "(a|b)*a";
+		for (int i = 0; i < k; i++) expr += "(a|b)";
+		return { { title_type::structure, "tail", expr, 1, false }, { title_type::structure, "identifier", "[_a-zA-Z][_a-zA-Z0-9]*", 2, false } };
+	}
+	// synthetic source of about size bytes, random words of a and b
+	std::string TailSource(size_t size, unsigned seed = 1) {
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> len(20, 60), ab(0, 1);
+		std::string src;
+		while (src.size() < size) {
+			for (int n = len(rng); n > 0; n--) src += ab(rng) ? 'a' : 'b';
+			src += ' ';
+		}
+		return src;
+	}
+	// time to build a lexer and scan a source, with the full dfa (skipped if full is false) and with the lazy one
+	void BenchLazy(const std::vector<token_define>& defs, const std::string& title, const std::string& src, bool full = true) {
+		std::cout << std::left << std::setw(10) << title << std::setw(12) << "build(ms)" << std::setw(12) << "MB/s" << "tokens\n";
+		size_t expect = 0;
+		auto run = [&](const char* name, auto build) {
+			auto t = std::chrono::steady_clock::now();
+			Matcher mc = build();
+			double buildMs = elapsedMs(t);
+			t = std::chrono::steady_clock::now();
+			auto tokens = mc.Scan(src);
+			double ms = elapsedMs(t);
+			if (expect != 0 && tokens.size() != expect) std::cout << "tokens differ from full dfa\n";
+			expect = tokens.size();
+			std::cout << std::left << std::setw(10) << name << std::setw(12) << buildMs << std::setw(12) << src.size() / 1048576.0 / (ms / 1000) << tokens.size() << '\n';
+		};
+		if (full) run("full", [&defs]() { return Matcher(BuildTable(defs)); });
+		run("lazy", [&defs]() { return Matcher(LazyDFA(BuildNfa(defs))); });
+	}
+	// weights of statements in a synthetic tiny source
+	struct TinyMix {
+		std::string name;
+		int identifiers, numbers, comments, keywords;
+	};
+	// token mixes measured by the suite
+	const std::vector<TinyMix>& TinyMixes() {
+		static const std::vector<TinyMix> mixes = {
+			{ "balanced", 3, 2, 2, 3 },
+			{ "identifiers", 8, 1, 0, 1 },
+			{ "comments", 1, 1, 8, 0 },
+			{ "numbers", 1, 8, 0, 1 },
+		};
+		return mixes;
+	}
+	namespace {
+		// append statements of tiny to src until it reaches size bytes
+		void tinyStatements(std::string& src, size_t size, const TinyMix& mix, std::mt19937& rng) {
+			static const char* const words[] = { "count", "total", "value", "index", "limit", "result", "factor", "buffer", "offset", "step" };
+			std::discrete_distribution<int> pick({ (double)mix.identifiers, (double)mix.numbers, (double)mix.comments, (double)mix.keywords });
+			std::uniform_int_distribution<int> any(0, 1 << 30);
+			auto name = [&]() { // identifiers from a few thousand spellings
+				auto n = any(rng);
+				return std::string(words[n % 10]) + (n & 1 ? "_" : "") + std::to_string(n % 397);
+			};
+			auto number = [&]() {
+				auto n = any(rng);
+				switch (n % 3) {
+				case 0: return std::to_string(n % 100000);
+				case 1: return std::to_string(n % 1000) + "." + std::to_string(n % 9973);
+				default: return std::to_string(n % 100) + "." + std::to_string(n % 97) + "lf";
+				}
+			};
+			const char* ops[] = { " + ", " - ", " * ", " / " };
+			while (src.size() < size) {
+				src.append(any(rng) % 3 * 2, ' '); // indentation
+				switch (pick(rng))
+				{
+				case 0:
+					src += name() + " := " + name() + ops[any(rng) % 4] + name() + ops[any(rng) % 4] + "(" + name() + " - " + name() + ");\n";
+					break;
+				case 1:
+					src += name() + " := " + number() + ops[any(rng) % 4] + number() + ops[any(rng) % 4] + number() + " * " + number() + ";\n";
+					break;
+				case 2:
+					if (any(rng) % 2) src += "// " + name() + " is updated here before the loop, see the notes above\n";
+					else src += "/* " + name() + " holds the value read\n   from input - checked against " + name() + " below */\n";
+					break;
+				default:
+					switch (any(rng) % 4) {
+					case 0: src += "if " + name() + " < " + name() + " then\n"; break;
+					case 1: src += "repeat\n"; break;
+					case 2: src += "until " + name() + " = 0;\n"; break;
+					default: src += (any(rng) % 2 ? "read " : "write ") + name() + ";\nend;\n"; break;
+					}
+					break;
+				}
+			}
+		}
+	}
+	// synthetic tiny source of about size bytes with a mix of statements
+	std::string TinySource(size_t size, const TinyMix& mix, unsigned seed = 1) {
+		std::mt19937 rng(seed);
+		std::string src;
+		src.reserve(size + 256);
+		tinyStatements(src, size, mix, rng);
+		return src;
+	}
+	// write a synthetic tiny source of about size bytes to a file a block at a time, so sources of gigabytes need little memory
+	bool WriteTinySource(const std::string& route, size_t size, const TinyMix& mix, unsigned seed = 1) {
+		std::mt19937 rng(seed);
+		std::ofstream fout(route, std::ios::binary | std::ios::trunc);
+		std::string block;
+		for (size_t written = 0; written < size && fout; written += block.size()) {
+			block.clear();
+			tinyStatements(block, std::min<size_t>(size - written, 1 << 20), mix, rng);
+			fout.write(block.data(), block.size());
+		}
+		return (bool)fout;
+	}
+	// benchmark suite reported as json: construction time and size of the lexer of a spec,
+	// then throughput of the matcher on synthetic sources of each mix and size (in bytes)
+	// sources from LARGE bytes are written to a file and mapped, like StreamFile in main; tokens are counted as streamed
+	void BenchSuite(const std::vector<token_define>& defs, const std::vector<size_t>& sizes, std::ostream& json) {
+		constexpr size_t LARGE = 256 << 20;
+		const char* levels[] = { "scalar", "sse2", "ssse3", "avx2" };
+		auto modes = SplitModes(defs); // each mode is built on its own
+		std::vector<std::string> names;
+		for (const auto& m : modes) names.push_back(m.name);
+		auto t = std::chrono::steady_clock::now();
+		std::vector<Automaton> dfas;
+		for (const auto& m : modes) dfas.push_back(BuildLexer(ModeDefs(defs, m.rules)));
+		double thompson = elapsedMs(t);
+		t = std::chrono::steady_clock::now();
+		for (const auto& m : modes) BuildLexer(ModeDefs(defs, m.rules), LexBuild::Direct);
+		double direct = elapsedMs(t);
+		t = std::chrono::steady_clock::now();
+		std::vector<LexTable> tables;
+		for (const auto& dfa : dfas) tables.push_back(LexTable::Compile(dfa));
+		auto table = tables.size() == 1 ? tables[0] : LexTable::Join(tables, names);
+		double compile = elapsedMs(t);
+		t = std::chrono::steady_clock::now();
+		std::vector<Automaton> nfas;
+		for (const auto& m : modes) nfas.push_back(BuildNfa(ModeDefs(defs, m.rules)));
+		LazyDFA lz(nfas, names);
+		double lazy = elapsedMs(t);
+		auto count = [](const std::vector<Automaton>& ats, bool states) {
+			size_t n = 0;
+			for (const auto& at : ats) n += states ? at.states.size() : at.transitions.size();
+			return n;
+		};
+
+		json << std::fixed << std::setprecision(3);
+		json << "{\n";
+		json << "  \"simd\": \"" << levels[ByteScan::Current()] << "\",\n";
+		json << "  \"cores\": " << std::thread::hardware_concurrency() << ",\n";
+		json << "  \"build\": {\n";
+		json << "    \"rules\": " << defs.size() << ",\n";
+		json << "    \"modes\": " << modes.size() << ",\n";
+		json << "    \"thompson_ms\": " << thompson << ",\n";
+		json << "    \"direct_ms\": " << direct << ",\n";
+		json << "    \"compile_ms\": " << compile << ",\n";
+		json << "    \"lazy_ms\": " << lazy << ",\n";
+		json << "    \"nfa_states\": " << count(nfas, true) << ",\n";
+		json << "    \"nfa_transitions\": " << count(nfas, false) << ",\n";
+		json << "    \"dfa_states\": " << count(dfas, true) << ",\n";
+		json << "    \"dfa_transitions\": " << count(dfas, false) << ",\n";
+		json << "    \"table_states\": " << table.stateCount << ",\n";
+		json << "    \"table_classes\": " << table.classCount << "\n";
+		json << "  },\n";
+		json << "  \"scan\": [";
+		bool first = true;
+		Matcher mc(table);
+		for (const auto& mix : TinyMixes())
+			for (auto size : sizes) {
+				std::string src;
+				std::string route = "bench-" + mix.name + ".tmp";
+				if (size < LARGE) src = TinySource(size, mix);
+				else if (!WriteTinySource(route, size, mix)) {
+					std::cout << "cannot write " << route << '\n';
+					continue;
+				}
+				double ms = 0;
+				size_t tokens = 0, bytes = size < LARGE ? src.size() : (size_t)std::filesystem::file_size(route);
+				int rounds = size < LARGE ? 3 : 1;
+				for (int round = 0; round < rounds; round++) { // best of rounds
+					t = std::chrono::steady_clock::now();
+					tokens = 0;
+					{ // tokens are counted, not stored, the source is released when the stream goes
+						auto stream = size < LARGE ? mc.Stream(src) : mc.StreamFile(route);
+						Token tk;
+						while (stream.Next(tk)) tokens++;
+					}
+					double r = elapsedMs(t);
+					if (round == 0 || r < ms) ms = r;
+				}
+				if (size >= LARGE) {
+					std::error_code ec;
+					std::filesystem::remove(route, ec);
+				}
+				json << (first ? "\n" : ",\n");
+				first = false;
+				json << "    { \"mix\": \"" << mix.name << "\", \"bytes\": " << bytes << ", \"tokens\": " << tokens << ", \"ms\": " << ms
+					<< ", \"mb_per_s\": " << bytes / 1048576.0 / (ms / 1000) << ", \"tokens_per_s\": " << tokens / (ms / 1000) << " }";
+				std::cout << std::left << std::setw(12) << mix.name << std::setw(12) << bytes << std::setw(12) << bytes / 1048576.0 / (ms / 1000) << "MB/s\n";
+			}
+		json << "\n  ]\n}\n";
+	}
+}
\ No newline at end of file
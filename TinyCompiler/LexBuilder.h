@@ -0,0 +1,259 @@
+#pragma once
+#include<vector>
+#include<string>
+#include<thread>
+#include<atomic>
+#include<exception>
+#include<algorithm>
+
+#include"LexFileLoader.h"
+#include"RegExpParser.h"
+#include"RegexAst.h"
+#include"Automaton.h"
+#include"DFA.h"
+#include"DirectDFA.h"
+#include"LexTable.h"
+#include"LazyDFA.h"
+
+namespace hscp {
+	// ways to build lexer automaton
+	enum class LexBuild {
+		Thompson, // each rule: regex -> nfa -> dfa -> minimized dfa, then merge and convert again
+		Direct // all rules to one dfa by followpos
+	};
+	// nfa of a rule from its simplified syntax tree, compiled by the loader if it has referrences
+	Automaton RuleNfa(const token_define& d) {
+		return d.ast ? Automaton::RegexAst2NFA(*d.ast, d.id) : Automaton::RegexAst2NFA(RegexAst::Parse(d.expr), d.id);
+	}
+	// convert a rule to minimized dfa: regex -> nfa -> dfa -> minimized dfa
+	Automaton BuildRule(const token_define& d) {
+		// convert to simplified syntax tree then to NFA
+		auto nfa = RuleNfa(d);
+		// to DFA
+		auto dfa = DFAConverter::Nfa2Dfa(nfa);
+		// minimize
+		return DFAminimizer(dfa);
+	}
+	// run job(i) for i in [0, n) on a few threads (0 for all cores), each thread takes the next index when it is free
+	// the first exception thrown by a job is thrown again here
+	template<typename F>
+	void ParallelFor(size_t n, F&& job, unsigned threads = 0) {
+		if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = (unsigned)std::min<size_t>(threads, n);
+		std::atomic<size_t> next{ 0 };
+		std::exception_ptr error;
+		std::atomic<bool> failed{ false };
+		auto work = [&]() {
+			for (size_t i; !failed && (i = next++) < n;) {
+				try { job(i); }
+				catch (...) {
+					if (!failed.exchange(true)) error = std::current_exception();
+				}
+			}
+		};
+		std::vector<std::thread> workers;
+		for (unsigned k = 1; k < threads; k++)
+			workers.emplace_back(work);
+		work(); // this thread works too
+		for (auto& w : workers)
+			w.join();
+		if (error) std::rethrow_exception(error);
+	}
+	// minimized dfa of each rule, rules are independent so they are built on a few threads (0 for all cores)
+	std::vector<Automaton> BuildRules(const std::vector<token_define>& defs, unsigned threads = 0) {
+		std::vector<Automaton> rules(defs.size());
+		ParallelFor(defs.size(), [&](size_t i) { rules[i] = BuildRule(defs[i]); }, threads);
+		return rules;
+	}
+	// rules of a mode (see token_define::mode)
+	struct modeRules {
+		std::string name;
+		std::vector<size_t> rules; // indexes in defs, in order
+	};
+	// rules by mode, the initial mode first, then others in order of definition
+	std::vector<modeRules> SplitModes(const std::vector<token_define>& defs) {
+		std::vector<modeRules> modes{ { initial_mode, {} } };
+		for (size_t i = 0; i < defs.size(); i++) {
+			auto name = defs[i].mode.empty() ? initial_mode : defs[i].mode;
+			auto it = std::find_if(modes.begin(), modes.end(), [&name](const modeRules& m) { return m.name == name; });
+			if (it == modes.end()) it = modes.insert(modes.end(), { name, {} });
+			it->rules.push_back(i);
+		}
+		return modes;
+	}
+	// some of defs or rules, in order
+	template<typename T>
+	std::vector<T> PickRules(const std::vector<T>& all, const std::vector<size_t>& pick) {
+		std::vector<T> some;
+		for (auto i : pick) some.push_back(all[i]);
+		return some;
+	}
+	// rules of a mode as rules of a lexer on its own
+	std::vector<token_define> ModeDefs(const std::vector<token_define>& defs, const std::vector<size_t>& pick) {
+		auto some = PickRules(defs, pick);
+		for (auto& d : some) d.mode.clear();
+		return some;
+	}
+	// compile each mode by build(rules of mode) and join them, see LexTable::Join
+	template<typename F>
+	LexTable JoinModes(const std::vector<modeRules>& modes, F&& build) {
+		std::vector<LexTable> tables;
+		std::vector<std::string> names;
+		for (const auto& m : modes) {
+			tables.push_back(build(m.rules));
+			names.push_back(m.name);
+		}
+		return LexTable::Join(tables, names);
+	}
+	// nfa of each rule merged without determinizing, for LazyDFA, rules come first have priority
+	// all rules are in one mode, see BuildLazy
+	Automaton BuildNfa(const std::vector<token_define>& defs) {
+		std::vector<Automaton> rules(defs.size());
+		for (size_t i = 0; i < defs.size(); i++)
+			rules[i] = RuleNfa(defs[i]);
+		return Automaton::Merge(rules);
+	}
+	// merge minimized dfa of rules to one minimized dfa, rules come first have priority
+	Automaton MergeRules(const std::vector<Automaton>& rules) {
+		auto at = Automaton::Merge(rules); // one big automaton, each rule is copied once
+		at = DFAConverter::Nfa2Dfa(at);  // there're epsilons and transitions accept same inputs after merge
+		return DFAminimizer(at); // final states of different tokens are never merged
+	}
+	// lazy lexer of token definitions, with a merged nfa of each mode
+	LazyDFA BuildLazy(const std::vector<token_define>& defs) {
+		auto modes = SplitModes(defs);
+		if (modes.size() == 1) return LazyDFA(BuildNfa(defs));
+		std::vector<Automaton> nfas;
+		std::vector<std::string> names;
+		for (const auto& m : modes) {
+			nfas.push_back(BuildNfa(ModeDefs(defs, m.rules)));
+			names.push_back(m.name);
+		}
+		return LazyDFA(nfas, names);
+	}
+	// build minimized lexer dfa from token definitions, rule defined first has priority
+	// all rules are in one mode, see BuildTable
+	Automaton BuildLexer(const std::vector<token_define>& defs, LexBuild how = LexBuild::Thompson) {
+		if (how == LexBuild::Direct)
+			return DFAminimizer(DirectDFA::Regex2Dfa(defs));
+		return MergeRules(BuildRules(defs));
+	}
+	// a reserve word left out of the dfa, found by hash after a match of its host rule
+	struct splitKeyword {
+		std::string word, is, host;
+	};
+	// the only string a minimized dfa accepts, false if it accepts others
+	bool literalOf(const Automaton& dfa, std::string& word) {
+		word.clear();
+		if (dfa.startState == NOSTATE) return false;
+		for (uint32_t s = dfa.startState;;) {
+			const transition* only = nullptr;
+			int count = 0;
+			dfa.EachTransition(s, [&only, &count](const transition& t) {
+				only = &t;
+				count++;
+				});
+			if (count == 0) return dfa.states[s].finalState;
+			if (count > 1 || dfa.states[s].finalState || !only->input.isSingle()) return false;
+			word += (char)only->input.from;
+			s = only->to;
+		}
+	}
+	// lexical meaning of the state a word leads to from start, empty if it is not final
+	std::string readWord(const Automaton& dfa, const std::string& word) {
+		uint32_t s = dfa.startState;
+		for (unsigned char ch : word) {
+			if (s == NOSTATE) return "";
+			uint32_t to = NOSTATE;
+			dfa.EachTransition(s, [&to, ch](const transition& t) {
+				if (t.input != 0 && t.input.from <= ch && t.input.to >= ch) to = t.to;
+				});
+			s = to;
+		}
+		return s != NOSTATE && dfa.states[s].finalState ? dfa.states[s].is : "";
+	}
+	// split reserve words off a lexer, plain is the lexer built from all but reserve words, rules[i] is the minimized dfa of reserve word defs[i]
+	// a reserve word is split off if plain reads it as one token of a rule defined after it (its host),
+	// then the lexer reads the same tokens in any context, only that token turns into the reserve word
+	// kept tells rules which stay in the dfa
+	std::vector<splitKeyword> SplitKeywords(const std::vector<token_define>& defs, const std::vector<Automaton>& rules, const Automaton& plain, std::vector<bool>& kept) {
+		std::vector<splitKeyword> split;
+		kept.assign(defs.size(), true);
+		for (size_t i = 0; i < defs.size(); i++) {
+			std::string word;
+			if (defs[i].type != title_type::reserve || !literalOf(rules[i], word)) continue;
+			auto host = readWord(plain, word);
+			if (host.empty()) continue;
+			auto first = std::find_if(defs.begin(), defs.end(), [&host](const token_define& d) { return d.id == host; });
+			if (first - defs.begin() < (long long)i) continue; // host has priority, keep as it is
+			split.push_back({ word, defs[i].id, host });
+			kept[i] = false;
+		}
+		return split;
+	}
+	// compile a dfa, with reserve words split off it found by hash
+	LexTable CompileLexer(const Automaton& dfa, const std::vector<splitKeyword>& split) {
+		auto tb = LexTable::Compile(dfa);
+		std::vector<KeywordHash::keyword> keys;
+		for (const auto& k : split) {
+			int host = tb.KindOf(k.host);
+			if (host == LexTable::NONE) continue;
+			int kind = tb.KindOf(k.is);
+			if (kind == LexTable::NONE) {
+				kind = (int)tb.kinds.size();
+				tb.kinds.push_back(k.is);
+			}
+			keys.push_back({ k.word, kind, host });
+		}
+		tb.keywords = KeywordHash::Build(keys);
+		return tb;
+	}
+	// compiled lexer merged from minimized dfa of each rule, rules[i] is built from defs[i]
+	// with hashKeywords, reserve words are split off the dfa when possible, see SplitKeywords
+	LexTable MergeTable(const std::vector<token_define>& defs, const std::vector<Automaton>& rules, bool hashKeywords = false) {
+		auto modes = SplitModes(defs);
+		if (modes.size() > 1) // a dfa of each mode
+			return JoinModes(modes, [&](const std::vector<size_t>& pick) { return MergeTable(ModeDefs(defs, pick), PickRules(rules, pick), hashKeywords); });
+		if (!hashKeywords)
+			return LexTable::Compile(MergeRules(rules));
+		auto pick = [&rules](const std::vector<bool>& kept) {
+			std::vector<Automaton> some;
+			for (size_t i = 0; i < rules.size(); i++)
+				if (kept[i]) some.push_back(rules[i]);
+			return MergeRules(some);
+		};
+		std::vector<bool> plainRule(defs.size()), kept;
+		for (size_t i = 0; i < defs.size(); i++)
+			plainRule[i] = defs[i].type != title_type::reserve;
+		auto plain = pick(plainRule);
+		auto split = SplitKeywords(defs, rules, plain, kept);
+		return CompileLexer(kept == plainRule ? plain : pick(kept), split);
+	}
+	// build compiled lexer from token definitions, rule defined first has priority
+	// with hashKeywords, reserve words are split off the dfa when possible, see SplitKeywords
+	LexTable BuildTable(const std::vector<token_define>& defs, LexBuild how = LexBuild::Thompson, bool hashKeywords = false) {
+		auto modes = SplitModes(defs);
+		if (modes.size() > 1) // a dfa of each mode
+			return JoinModes(modes, [&](const std::vector<size_t>& pick) { return BuildTable(ModeDefs(defs, pick), how, hashKeywords); });
+		if (!hashKeywords)
+			return LexTable::Compile(BuildLexer(defs, how));
+		if (how == LexBuild::Thompson)
+			return MergeTable(defs, BuildRules(defs), true);
+
+		// direct builder makes the whole lexer at once, only reserve words need a dfa of their own
+		std::vector<Automaton> rules(defs.size());
+		std::vector<bool> plainRule(defs.size()), kept;
+		for (size_t i = 0; i < defs.size(); i++)
+			plainRule[i] = defs[i].type != title_type::reserve;
+		ParallelFor(defs.size(), [&](size_t i) { if (!plainRule[i]) rules[i] = BuildRule(defs[i]); });
+		auto build = [&defs, how](const std::vector<bool>& pick) {
+			std::vector<token_define> some;
+			for (size_t i = 0; i < defs.size(); i++)
+				if (pick[i]) some.push_back(defs[i]);
+			return BuildLexer(some, how);
+		};
+		auto plain = build(plainRule);
+		auto split = SplitKeywords(defs, rules, plain, kept);
+		return CompileLexer(kept == plainRule ? plain : build(kept), split);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,305 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<unordered_map>
+#include<fstream>
+#include<sstream>
+#include<filesystem>
+#include<memory>
+#include<cstring>
+#include<cstdint>
+
+#include"LexFileLoader.h"
+#include"Automaton.h"
+#include"LexTable.h"
+#include"LexBuilder.h"
+#include"MappedFile.h"
+
+namespace hscp {
+	// compiled lexer cached on disk beside its spec, mapped read-only when the spec is unchanged
+	// layout: header (with classOf) | next[states * classes] | accept[states] | kinds | keyword hash | modes | minimized dfa of each rule
+	class LexCache {
+	private:
+		static constexpr char MAGIC[8] = "HSCPLEX";
+		static constexpr uint32_t VERSION = 4; // bump when layout or lexer construction changes
+		static constexpr uint32_t ENDIAN = 0x01020304;
+		struct header {
+			char magic[8];
+			uint32_t version;
+			uint32_t endian; // in byte order of writer
+			uint64_t specHash;
+			uint64_t fileSize;
+			uint64_t bodyHash; // of all after the header, a damaged file is rebuilt
+			uint32_t stateCount, classCount;
+			uint32_t kindCount, ruleCount;
+			uint64_t nextOffset, acceptOffset, kindsOffset, rulesOffset;
+			unsigned char classOf[256];
+		};
+		// append raw data to a buffer
+		struct writer {
+			std::string buf;
+			template<typename T>
+			void put(const T& v) { buf.append((const char*)&v, sizeof(T)); }
+			void put(const void* p, size_t n) { buf.append((const char*)p, n); }
+			void str(const std::string& s) { put((uint32_t)s.size()); buf += s; }
+			void align() { buf.resize((buf.size() + 7) & ~(size_t)7, '\0'); } // keep arrays aligned in mapping
+		};
+		// read raw data from a buffer, ok turns false on overflow
+		struct reader {
+			const char* p, * end;
+			bool ok = true;
+			template<typename T>
+			T get() {
+				T v{};
+				if ((size_t)(end - p) < sizeof(T)) { ok = false; return v; }
+				std::memcpy(&v, p, sizeof(T));
+				p += sizeof(T);
+				return v;
+			}
+			std::string str() {
+				auto n = get<uint32_t>();
+				if ((size_t)(end - p) < n) { ok = false; return ""; }
+				std::string s(p, n);
+				p += n;
+				return s;
+			}
+		};
+
+		// key of a rule, expressions referred count by the tree compiled with them
+		static uint64_t ruleHash(const token_define& d) {
+			uint64_t h = Fnv1a(&VERSION, sizeof(VERSION));
+			h = Fnv1a(d.id.data(), d.id.size() + 1, h); // with terminating zero as separator
+			h = Fnv1a(d.expr.data(), d.expr.size(), h);
+			if (!d.ast) return h;
+			uint64_t tree = d.ast->Hash();
+			return Fnv1a(&tree, sizeof(tree), h);
+		}
+		// check header and bounds of a mapped cache
+		static const header* check(const MappedFile& mf) {
+			if (!mf.Valid() || mf.Size() < sizeof(header)) return nullptr;
+			auto h = (const header*)mf.Data();
+			if (std::memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 || h->version != VERSION || h->endian != ENDIAN || h->fileSize != mf.Size() ||
+				h->bodyHash != Fnv1a(mf.Data() + sizeof(header), mf.Size() - sizeof(header)))
+				return nullptr;
+			size_t cells = (size_t)h->stateCount * h->classCount;
+			if (h->stateCount == 0 || h->stateCount >= LexTable::DEAD || h->classCount == 0 || h->classCount > 256 ||
+				h->nextOffset + cells * sizeof(uint16_t) > h->acceptOffset || h->acceptOffset + h->stateCount * sizeof(int32_t) > h->kindsOffset ||
+				h->nextOffset > h->fileSize || h->kindsOffset > h->rulesOffset || h->rulesOffset > h->fileSize ||
+				h->nextOffset % alignof(uint16_t) != 0 || h->acceptOffset % alignof(int32_t) != 0)
+				return nullptr;
+			return h;
+		}
+		// table referring to a mapped cache, false if a state, class or token id in it is out of range (a damaged file)
+		static bool view(const std::shared_ptr<MappedFile>& mf, const header* h, LexTable& tb) {
+			for (int ch = 0; ch < 256; ch++)
+				if (h->classOf[ch] >= h->classCount) return false;
+			auto next = (const uint16_t*)(mf->Data() + h->nextOffset);
+			for (size_t i = 0; i < (size_t)h->stateCount * h->classCount; i++)
+				if (next[i] >= h->stateCount && next[i] != LexTable::DEAD) return false;
+			auto accept = (const int32_t*)(mf->Data() + h->acceptOffset);
+			for (uint32_t s = 0; s < h->stateCount; s++)
+				if (accept[s] < LexTable::NONE || accept[s] >= (int32_t)h->kindCount) return false;
+			tb.stateCount = h->stateCount;
+			tb.classCount = h->classCount;
+			tb.start = 0;
+			tb.classOf = h->classOf;
+			tb.next = next;
+			tb.accept = accept;
+			reader rd{ mf->Data() + h->kindsOffset, mf->Data() + h->rulesOffset };
+			tb.kinds.clear();
+			for (uint32_t i = 0; i < h->kindCount; i++)
+				tb.kinds.push_back(rd.str());
+			auto& kh = tb.keywords;
+			kh = {};
+			kh.lengths = rd.get<uint64_t>();
+			auto buckets = rd.get<uint32_t>(), slots = rd.get<uint32_t>();
+			if (!rd.ok || (buckets == 0) != (slots == 0) || (buckets == 0 && kh.lengths != 0) || (size_t)(rd.end - rd.p) < (size_t)buckets * 4 + (size_t)slots * 12) return false;
+			for (uint32_t b = 0; b < buckets; b++)
+				kh.seeds.push_back(rd.get<uint32_t>());
+			for (uint32_t i = 0; i < slots && rd.ok; i++) {
+				kh.words.push_back(rd.str());
+				kh.kinds.push_back(rd.get<int32_t>());
+				kh.hosts.push_back(rd.get<int32_t>());
+				if (kh.kinds.back() < KeywordHash::NONE || kh.kinds.back() >= (int32_t)h->kindCount ||
+					kh.hosts.back() < KeywordHash::NONE || kh.hosts.back() >= (int32_t)h->kindCount) return false;
+			}
+			tb.modes.clear();
+			tb.starts.clear();
+			auto modes = rd.get<uint32_t>();
+			for (uint32_t m = 0; m < modes && rd.ok; m++) {
+				tb.modes.push_back(rd.str());
+				tb.starts.push_back(rd.get<uint16_t>());
+				if (tb.starts.back() >= h->stateCount) return false;
+			}
+			for (const auto& k : tb.kinds) { // modes entered are in the table
+				auto to = LexTable::SplitKind(k).second;
+				if (!to.empty() && LexTable::ModeOf(tb.modes, to) == LexTable::NONE) return false;
+			}
+			if (!tb.starts.empty()) tb.start = tb.starts[0];
+			tb.storage = mf; // mapping lives as long as the table
+			return rd.ok;
+		}
+		// minimized dfa of rules in a mapped cache
+		static std::unordered_map<uint64_t, Automaton> cachedRules(const MappedFile& mf, const header* h) {
+			std::unordered_map<uint64_t, Automaton> rules;
+			reader rd{ mf.Data() + h->rulesOffset, mf.Data() + h->fileSize };
+			for (uint32_t i = 0; i < h->ruleCount && rd.ok; i++) {
+				auto key = rd.get<uint64_t>();
+				auto is = rd.str();
+				auto sc = rd.get<uint32_t>(), tc = rd.get<uint32_t>(), start = rd.get<uint32_t>();
+				if (!rd.ok || start >= sc || (size_t)(rd.end - rd.p) < (size_t)sc + (size_t)tc * 10) break; // damaged
+				Automaton at;
+				for (uint32_t s = 0; s < sc; s++)
+					at.states[at.NewState()].finalState = rd.get<uint8_t>() != 0;
+				for (auto& s : at.states)
+					if (s.finalState) s.is = is;
+				for (uint32_t t = 0; t < tc; t++) {
+					auto from = rd.get<uint32_t>(), to = rd.get<uint32_t>();
+					auto lo = rd.get<uint8_t>(), hi = rd.get<uint8_t>();
+					if (from >= sc || to >= sc) { rd.ok = false; break; }
+					at.NewTransition(from, to, CharRange(lo, hi));
+				}
+				at.startState = start;
+				at.classes = ByteClasses::Split(at.transitions);
+				if (rd.ok) rules.emplace(key, std::move(at));
+			}
+			return rules;
+		}
+		// cached dfa of a rule, null if not cached or its tokens are not named as the rule
+		static const Automaton* cachedRule(const std::unordered_map<uint64_t, Automaton>& cached, const token_define& d) {
+			auto it = cached.find(ruleHash(d));
+			if (it == cached.end()) return nullptr;
+			for (const auto& s : it->second.states)
+				if (s.finalState && s.is != d.id) return nullptr;
+			return &it->second;
+		}
+		// serialize table and rules, then replace the cache file
+		static void save(const std::string& route, uint64_t specHash, const LexTable& tb,
+			const std::vector<std::pair<uint64_t, const Automaton*>>& rules) {
+			header h{};
+			std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+			h.version = VERSION;
+			h.endian = ENDIAN;
+			h.specHash = specHash;
+			h.stateCount = tb.stateCount;
+			h.classCount = tb.classCount;
+			h.kindCount = (uint32_t)tb.kinds.size();
+			h.ruleCount = (uint32_t)rules.size();
+			std::memcpy(h.classOf, tb.classOf, 256);
+
+			writer w;
+			w.put(h); // offsets are filled at last
+			w.align();
+			h.nextOffset = w.buf.size();
+			w.put(tb.next, (size_t)tb.stateCount * tb.classCount * sizeof(uint16_t));
+			w.align();
+			h.acceptOffset = w.buf.size();
+			w.put(tb.accept, (size_t)tb.stateCount * sizeof(int32_t));
+			h.kindsOffset = w.buf.size();
+			for (const auto& k : tb.kinds)
+				w.str(k);
+			const auto& kh = tb.keywords;
+			w.put(kh.lengths);
+			w.put((uint32_t)kh.seeds.size());
+			w.put((uint32_t)kh.words.size());
+			for (auto seed : kh.seeds)
+				w.put(seed);
+			for (size_t i = 0; i < kh.words.size(); i++) {
+				w.str(kh.words[i]);
+				w.put(kh.kinds[i]);
+				w.put(kh.hosts[i]);
+			}
+			w.put((uint32_t)tb.modes.size());
+			for (size_t m = 0; m < tb.modes.size(); m++) {
+				w.str(tb.modes[m]);
+				w.put(tb.starts[m]);
+			}
+			h.rulesOffset = w.buf.size();
+			for (const auto& r : rules) {
+				const auto& at = *r.second;
+				std::string is;
+				for (const auto& s : at.states)
+					if (s.finalState) is = s.is;
+				w.put(r.first);
+				w.str(is);
+				w.put((uint32_t)at.states.size());
+				w.put((uint32_t)at.transitions.size());
+				w.put(at.startState);
+				for (const auto& s : at.states)
+					w.put((uint8_t)s.finalState);
+				for (const auto& t : at.transitions) {
+					w.put(t.from);
+					w.put(t.to);
+					w.put(t.input.from);
+					w.put(t.input.to);
+				}
+			}
+			h.fileSize = w.buf.size();
+			h.bodyHash = Fnv1a(w.buf.data() + sizeof(h), w.buf.size() - sizeof(h));
+			std::memcpy(&w.buf[0], &h, sizeof(h));
+
+			// write aside then rename, so a concurrent run never maps a half written file
+			std::string tmp = route + ".tmp";
+			{
+				std::ofstream fout(tmp, std::ios::binary | std::ios::trunc);
+				fout.write(w.buf.data(), w.buf.size());
+				if (!fout) return;
+			}
+			std::error_code ec;
+			std::filesystem::rename(tmp, route, ec);
+			if (ec) std::filesystem::remove(tmp, ec); // cache is optional, keep going without it
+		}
+	public:
+		// get compiled lexer of a spec: map the cache if the spec is unchanged,
+		// otherwise rebuild only rules whose expression changed, then merge and update the cache
+		// hashKeywords splits reserve words off the dfa, see SplitKeywords
+		static LexTable Load(const std::string& spec, LexBuild how = LexBuild::Thompson, bool hashKeywords = false) {
+			std::ifstream fin(spec, std::ios::binary);
+			std::stringstream content;
+			content << fin.rdbuf();
+			std::string text = content.str();
+			uint64_t specHash = Fnv1a(text.data(), text.size(), Fnv1a(&VERSION, sizeof(VERSION)));
+			specHash = Fnv1a(&hashKeywords, sizeof(hashKeywords), specHash); // tables differ by it
+			specHash = Fnv1a(&how, sizeof(how), specHash); // and by the builder, so -direct is not served a thompson table
+
+			std::string route = spec + ".cache";
+			auto mf = std::make_shared<MappedFile>(route);
+			auto h = check(*mf);
+			LexTable tb;
+			if (h != nullptr && h->specHash == specHash && view(mf, h, tb))
+				return tb; // nothing to build
+
+			std::unordered_map<uint64_t, Automaton> cached;
+			if (h != nullptr)
+				cached = cachedRules(*mf, h);
+			mf.reset(); // release the old file before replacing it
+
+			std::vector<token_define> defs;
+			FileLoader(spec, [](const auto& err) {}, [&defs](const std::vector<token_define>& d) { defs = d; });
+
+			std::vector<Automaton> rules(defs.size());
+			std::vector<std::pair<uint64_t, const Automaton*>> saved;
+			if (how == LexBuild::Direct) {
+				tb = BuildTable(defs, how, hashKeywords);
+				for (size_t i = 0; i < defs.size(); i++) { // keep rules still in the spec for the other builder
+					auto at = cachedRule(cached, defs[i]);
+					if (at != nullptr) saved.emplace_back(ruleHash(defs[i]), at);
+				}
+			}
+			else {
+				std::vector<size_t> changed;
+				for (size_t i = 0; i < defs.size(); i++) {
+					auto key = ruleHash(defs[i]);
+					auto at = cachedRule(cached, defs[i]);
+					if (at != nullptr) rules[i] = *at; // copied, rules alike share the entry
+					else changed.push_back(i);
+					saved.emplace_back(key, &rules[i]);
+				}
+				ParallelFor(changed.size(), [&](size_t k) { rules[changed[k]] = BuildRule(defs[changed[k]]); }); // build changed rules only
+				tb = MergeTable(defs, rules, hashKeywords);
+			}
+			save(route, specHash, tb, saved);
+			return tb;
+		}
+	};
+}
\ No newline at end of file
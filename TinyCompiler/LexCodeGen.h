@@ -0,0 +1,124 @@
+#pragma once
+#include<string>
+#include<fstream>
+#include<iostream>
+
+#include"LexTable.h"
+
+namespace hscp {
+	// write a compiled lexer as a c++ header of constexpr tables, so the lexer is built into the program
+	// the header gives a function returning a LexTable over those tables, to be used by Matcher like any other
+	class LexCodeGen {
+	private:
+		// c++ string literal of a lexical meaning
+		static std::string quote(const std::string& s) {
+			std::string q = "\"";
+			for (unsigned char ch : s) {
+				if (ch == '\\' || ch == '"') { q += '\\'; q += (char)ch; }
+				else if (ch < 32 || ch >= 127) { // octal escape for control and non-ascii chars
+					q += '\\';
+					q += (char)('0' + (ch >> 6));
+					q += (char)('0' + ((ch >> 3) & 7));
+					q += (char)('0' + (ch & 7));
+				}
+				else q += (char)ch;
+			}
+			return q + "\"";
+		}
+		// write numbers of an array, wrapped every line items
+		template<typename T>
+		static void array(std::ostream& out, const T* data, size_t n, size_t line) {
+			for (size_t i = 0; i < n; i++) {
+				if (i % line == 0) out << "\n\t\t\t";
+				out << (long long)data[i] << ',';
+			}
+			out << '\n';
+		}
+	public:
+		// write header, name is the function that returns the table
+		static void Generate(const LexTable& tb, std::ostream& out, const std::string& name = "GeneratedLexer") {
+			out << "// generated by TinyCompiler -genlex from lexical rules, do not edit\n";
+			out << "#pragma once\n#include<cstdint>\n#include<iterator>\n\n#include\"LexTable.h\"\n\n";
+			out << "namespace hscp {\n";
+			out << "\tnamespace " << name << "_data {\n";
+			out << "\t\tinline constexpr uint32_t stateCount = " << tb.stateCount << ";\n";
+			out << "\t\tinline constexpr uint32_t classCount = " << tb.classCount << ";\n";
+			out << "\t\tinline constexpr unsigned char classOf[256] = {";
+			array(out, tb.classOf, 256, 32);
+			out << "\t\t};\n";
+			out << "\t\tinline constexpr uint16_t next[" << (size_t)tb.stateCount * tb.classCount << "] = {";
+			array(out, tb.next, (size_t)tb.stateCount * tb.classCount, tb.classCount);
+			out << "\t\t};\n";
+			out << "\t\tinline constexpr int32_t accept[" << tb.stateCount << "] = {";
+			array(out, tb.accept, tb.stateCount, 32);
+			out << "\t\t};\n";
+			out << "\t\tinline const char* const kinds[] = {\n";
+			for (const auto& k : tb.kinds)
+				out << "\t\t\t" << quote(k) << ",\n";
+			if (tb.kinds.empty()) out << "\t\t\t\"\",\n"; // array can't be empty
+			out << "\t\t};\n";
+			if (!tb.modes.empty()) { // start of each mode
+				out << "\t\tinline const char* const modes[] = {\n";
+				for (const auto& m : tb.modes)
+					out << "\t\t\t" << quote(m) << ",\n";
+				out << "\t\t};\n";
+				out << "\t\tinline constexpr uint16_t starts[" << tb.starts.size() << "] = {";
+				array(out, tb.starts.data(), tb.starts.size(), 32);
+				out << "\t\t};\n";
+			}
+			const auto& kh = tb.keywords;
+			if (!kh.Empty()) { // reserve words split off the dfa
+				out << "\t\tinline constexpr uint64_t keywordLengths = " << kh.lengths << "ull;\n";
+				out << "\t\tinline constexpr uint32_t keywordSeeds[" << kh.seeds.size() << "] = {";
+				array(out, kh.seeds.data(), kh.seeds.size(), 16);
+				out << "\t\t};\n";
+				out << "\t\tinline const char* const keywordWords[] = {\n";
+				for (const auto& w : kh.words)
+					out << "\t\t\t" << quote(w) << ",\n";
+				out << "\t\t};\n";
+				out << "\t\tinline constexpr int32_t keywordKinds[" << kh.kinds.size() << "] = {";
+				array(out, kh.kinds.data(), kh.kinds.size(), 32);
+				out << "\t\t};\n";
+				out << "\t\tinline constexpr int32_t keywordHosts[" << kh.hosts.size() << "] = {";
+				array(out, kh.hosts.data(), kh.hosts.size(), 32);
+				out << "\t\t};\n";
+			}
+			out << "\t}\n";
+			out << "\t// compiled lexer built into the program\n";
+			out << "\tinline LexTable " << name << "() {\n";
+			out << "\t\tnamespace d = " << name << "_data;\n";
+			out << "\t\tLexTable tb;\n";
+			out << "\t\ttb.stateCount = d::stateCount;\n";
+			out << "\t\ttb.classCount = d::classCount;\n";
+			out << "\t\ttb.classOf = d::classOf;\n";
+			out << "\t\ttb.next = d::next;\n";
+			out << "\t\ttb.accept = d::accept;\n";
+			out << "\t\ttb.kinds.assign(std::begin(d::kinds), std::begin(d::kinds) + " << tb.kinds.size() << ");\n";
+			if (!tb.modes.empty()) {
+				out << "\t\ttb.modes.assign(std::begin(d::modes), std::end(d::modes));\n";
+				out << "\t\ttb.starts.assign(std::begin(d::starts), std::end(d::starts));\n";
+				out << "\t\ttb.start = d::starts[0];\n";
+			}
+			if (!kh.Empty()) {
+				out << "\t\ttb.keywords.lengths = d::keywordLengths;\n";
+				out << "\t\ttb.keywords.seeds.assign(std::begin(d::keywordSeeds), std::end(d::keywordSeeds));\n";
+				out << "\t\ttb.keywords.words.assign(std::begin(d::keywordWords), std::end(d::keywordWords));\n";
+				out << "\t\ttb.keywords.kinds.assign(std::begin(d::keywordKinds), std::end(d::keywordKinds));\n";
+				out << "\t\ttb.keywords.hosts.assign(std::begin(d::keywordHosts), std::end(d::keywordHosts));\n";
+			}
+			out << "\t\treturn tb; // static tables need no storage\n";
+			out << "\t}\n";
+			out << "}\n";
+		}
+		// write header to a file
+		static bool Generate(const LexTable& tb, const std::string& route, const std::string& name = "GeneratedLexer") {
+			std::ofstream fout(route, std::ios::trunc);
+			if (!fout) {
+				std::cout << "cannot write " << route << '\n';
+				return false;
+			}
+			Generate(tb, fout, name);
+			return (bool)fout;
+		}
+	};
+}
\ No newline at end of file
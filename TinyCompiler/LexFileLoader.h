@@ -6,19 +6,26 @@
 #include<iostream>
 #include<sstream>
 #include<functional>
+#include<memory>
+#include<algorithm>
+
+#include"RegexAst.h"
 
 namespace hscp {
 	enum class title_type // types of regex in config
 	{
 		reserve, symbol, structure
 	};
+	const std::string initial_mode = "initial"; // mode of rules out of [mode ...] sections
 	struct token_define // token in config
 	{
 		title_type type;
-		std::string id;
+		std::string id; // token name, with ' ' and the mode entered after the token if it switches mode (see LexTable::SplitKind)
 		std::string expr;
 		int line;
 		bool ref;
+		std::shared_ptr<const RegexAst> ast = nullptr; // expression compiled with referrences, parse expr if null
+		std::string mode = ""; // mode the rule is matched in, empty for the initial one
 	};
 	struct error // error info
 	{
@@ -30,7 +37,8 @@ namespace hscp {
 	private:
 		std::vector<token_define> tokens;
 		std::vector<error> errors;
-		std::string reg_reserve = "&|*.+[-]^?()`\\"; // symbols used to control regex
+		std::string mode; // of rules read
+		std::string reg_reserve = "&|*.+[-]^?(){}`\\"; // symbols used to control regex
 
 		std::map<std::string, title_type> title = { // string to title type
 			{"[reserve]", title_type::reserve},
@@ -38,13 +46,31 @@ namespace hscp {
 			{"[structure]", title_type::structure}
 		};
 		// read a line, return if it is a type (not regex), and pass out the type if true
+		// rules of [mode name] are structures matched only in that mode
 		bool is_title(const std::string& line, title_type& type) {
 			if (title.find(line) != title.end()) {
 				type = title[line];
+				mode.clear();
+				return true;
+			}
+			if (line.size() > 7 && line.compare(0, 6, "[mode ") == 0 && line.back() == ']') {
+				type = title_type::structure;
+				mode = line.substr(6, line.size() - 7);
+				if (mode == initial_mode) mode.clear();
 				return true;
 			}
 			return false;
 		}
+		// check modes entered by rules (name>mode) are defined
+		void check_modes() {
+			for (const auto& t : tokens) {
+				auto sp = t.id.find(' ');
+				if (sp == std::string::npos) continue;
+				auto to = t.id.substr(sp + 1);
+				if (to != initial_mode && find_if(tokens.begin(), tokens.end(), [&to](const token_define& e) {return e.mode == to; }) == tokens.end())
+					errors.push_back({ t.line, "mode not found" });
+			}
+		}
 		// add escape before characters act as control character (only in [symbol])
 		void pre_escape() {
 			for (auto& e : tokens) {
@@ -58,40 +84,46 @@ namespace hscp {
 				}
 			}
 		}
-		// replace referrence (quoted by '`') with referred expression
+		// compile expressions with referrence (quoted by '`') to syntax trees, a referred expression is compiled once
+		// and its tree copied into each referrer, so nested referrences cost no more than the expressions written
 		void dereferrence() {
-			for (auto& i : tokens) {
-				// reference syntax only exist in [structure] field
-				if (i.type != title_type::structure) continue;
-
-				size_t offset = 0;
-				size_t refsign_pos = i.expr.find('`'); // refer symbol
-				while (refsign_pos != std::string::npos) { // read all ref symbol
-					if (refsign_pos == 0 || i.expr[refsign_pos - 1] != '\\') { // this is not escaped ref symbol
-						size_t right_pos = i.expr.find('`', refsign_pos + 1); // close symbol
-						if (right_pos != std::string::npos && i.expr[right_pos - 1] != '\\') // not escaped
-						{
-							std::string ref_key = i.expr.substr(refsign_pos + 1, right_pos - refsign_pos - 1); // get key
-							auto it = find_if(tokens.begin(), tokens.end(), [ref_key](const token_define& e) {return e.id == ref_key; }); // referred expression
-							if (it != tokens.end()) {
-								i.expr.replace(refsign_pos, right_pos - refsign_pos + 1, "(" + (*it).expr + ")"); // copy expression
+			enum { fresh, compiling, compiled };
+			std::vector<int> state(tokens.size(), fresh);
+			struct reported {}; // error reported already, the referrer fails too
+			std::function<const RegexAst*(size_t)> compile = [&](size_t i) -> const RegexAst* {
+				auto& t = tokens[i];
+				if (state[i] == compiled) return t.ast.get();
+				state[i] = compiling;
+				try {
+					if (t.type != title_type::structure) // reference syntax only exist in [structure] field
+						t.ast = std::make_shared<RegexAst>(RegexAst::Parse(t.expr));
+					else
+						t.ast = std::make_shared<RegexAst>(RegexAst::Parse(t.expr, [&](const std::string& key) {
+							auto it = find_if(tokens.begin(), tokens.end(), [&key](const token_define& e) {return e.id == key; }); // referred expression
+							if (it == tokens.end()) {
+								errors.push_back({ t.line, "referrence key not found" }); // rules has error
+								throw reported{};
 							}
-							else {
-								errors.push_back({ i.line, "referrence key not found" }); // rules has error
-								offset = refsign_pos + 1;
+							size_t j = it - tokens.begin();
+							if (state[j] == compiling) {
+								errors.push_back({ t.line, "cyclic referrence" }); // refers to itself at last
+								throw reported{};
 							}
-						}
-						else {
-							errors.push_back({ i.line, "invalid referrence symbol" }); // single ref symbol error
-							offset = refsign_pos + 1;
-						}
-					}
-					else {
-						offset = refsign_pos + 1;
-					}
-					refsign_pos = i.expr.find('`', offset); // find next
+							auto ast = compile(j);
+							if (ast == nullptr) throw reported{};
+							return ast;
+						}));
 				}
-			}
+				catch (const reported&) {}
+				catch (const std::exception& e) {
+					errors.push_back({ t.line, e.what() }); // like a single ref symbol
+				}
+				state[i] = compiled;
+				return t.ast.get();
+			};
+			for (size_t i = 0; i < tokens.size(); i++)
+				if (tokens[i].type == title_type::structure && tokens[i].expr.find('`') != std::string::npos)
+					compile(i);
 		}
 		// load lexture file
 		void load_lex(const std::string& def_file) {
@@ -111,22 +143,24 @@ namespace hscp {
 					if (k[0] == '^') {
 						tokens.push_back({ type,k.substr(1),v,count,true }); // this is referrence item, which can be referred and will be delete afterwards
 					}
-					else
+					else {
+						auto to = k.find('>'); // name>mode switches mode after the token, no name starts the next token
+						if (type == title_type::structure && to != std::string::npos && to + 1 < k.size())
+							k = k.substr(0, to) + ' ' + k.substr(to + 1);
 						tokens.push_back({ type,k,v,count,false }); // this is expression item
+					}
+					tokens.back().mode = mode;
 				}
 			}
 			// escape symbols in [sign] field
 			pre_escape();
 			// move referred item to its referrer
 			dereferrence();
+			check_modes();
 		}
 		// remove referrence only
 		void rmref() {
-			auto it = tokens.begin();
-			while ((it = find_if(it, tokens.end(), [](const auto& t) {return t.ref; })) != tokens.end()) {
-				it--;
-				tokens.erase(it + 1);
-			}
+			tokens.erase(std::remove_if(tokens.begin(), tokens.end(), [](const auto& t) {return t.ref; }), tokens.end());
 		}
 
 	public:
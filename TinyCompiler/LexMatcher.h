@@ -1,101 +1,665 @@
 #pragma once
 #include<string>
+#include<string_view>
+#include<vector>
+#include<memory>
 #include<fstream>
+#include<iostream>
+#include<iterator>
+#include<filesystem>
+#include<thread>
+#include<algorithm>
+#include<cstring>
 
 #include"Automaton.h"
+#include"LexTable.h"
+#include"LazyDFA.h"
+#include"MappedFile.h"
+#include"Interner.h"
+#include"ByteScan.h"
+#include"LineIndex.h"
 
 namespace hscp {
-	struct Token { // an lexical token
-		std::string type; // nonused token type
-		std::string is; // tells token name
-		std::string content; // token contents
-		long long value; // nonused token contents
-		int line, column; // token position in source file
+	// a hold on a source of Sources(), the source is removed when its last hold goes, and its id is given again
+	class SourceRef {
+	private:
+		static constexpr uint32_t NONE = 0x10000;
+		uint32_t id = NONE;
+	public:
+		SourceRef() = default;
+		explicit SourceRef(uint16_t id);
+		SourceRef(const SourceRef& other);
+		SourceRef(SourceRef&& other) noexcept :id(other.id) { other.id = NONE; }
+		SourceRef& operator=(SourceRef other) noexcept {
+			std::swap(id, other.id);
+			return *this;
+		}
+		~SourceRef();
+		uint16_t Id() const { return (uint16_t)id; }
+		bool Empty() const { return id == NONE; }
+	};
+	// sources scanned into tokens, a source stays while a SourceRef holds it, so token contents are valid as long as it is held
+	// positions of tokens are found from their offsets by a line index of the source, made when first asked
+	class SourceTable {
+	private:
+		struct source {
+			std::string_view text;
+			std::shared_ptr<const void> owner; // mapped file or read stream, null if owned by caller
+			std::pair<int, int> origin; // line and column of the first byte, line 0 if it has no positions
+			std::unique_ptr<LineIndex> lines;
+			uint32_t holds = 0;
+		};
+		std::vector<source> sources;
+		std::vector<uint16_t> unused; // ids of sources removed
+		friend class SourceRef;
+	public:
+		static constexpr size_t MAXSIZE = 0xFFFFFFFF; // bytes of a source, tokens keep 32 bit offsets and lengths
+
+		// add a source, owner keeps its text alive, line and column are of its first byte (0 for no positions, like the delimiter)
+		SourceRef Add(std::string_view text, std::shared_ptr<const void> owner, int line = 1, int column = 1) {
+			if (text.size() > MAXSIZE) throw std::exception("source too large, 4 GB at most");
+			uint16_t id;
+			if (!unused.empty()) {
+				id = unused.back();
+				unused.pop_back();
+			}
+			else {
+				if (sources.size() > 0xFFFF) throw std::exception("too many sources");
+				id = (uint16_t)sources.size();
+				sources.emplace_back();
+			}
+			auto& s = sources[id];
+			s.text = text;
+			s.owner = std::move(owner);
+			s.origin = { line, column };
+			return SourceRef(id);
+		}
+		// a source fed in pieces has more text, from the same start
+		void Grow(uint16_t id, std::string_view text) {
+			if (text.size() > MAXSIZE) throw std::exception("source too large, 4 GB at most");
+			sources[id].text = text;
+		}
+		std::string_view Get(uint16_t id) const {
+			return sources[id].text;
+		}
+		// sources held, for leak checks
+		size_t Size() const {
+			return sources.size() - unused.size();
+		}
+		// line and column of an offset in a source, from 1, -1 if the source has no positions
+		std::pair<int, int> Position(uint16_t id, uint32_t offset) {
+			auto& s = sources[id];
+			auto [line, column] = s.origin;
+			if (line == 0) return { -1,-1 };
+			if (!s.lines) s.lines = std::make_unique<LineIndex>();
+			auto& index = *s.lines;
+			index.Extend(s.text);
+			int l = index.Line(offset);
+			return { line + l - 1, l == 1 ? column + (int)offset : index.Column(offset) };
+		}
+	};
+	inline SourceTable& Sources() {
+		static SourceTable sources;
+		return sources;
+	}
+	inline SourceRef::SourceRef(uint16_t id) :id(id) {
+		Sources().sources[id].holds++;
+	}
+	inline SourceRef::SourceRef(const SourceRef& other) :id(other.id) {
+		if (id != NONE) Sources().sources[id].holds++;
+	}
+	inline SourceRef::~SourceRef() {
+		if (id == NONE) return;
+		auto& table = Sources();
+		auto& s = table.sources[id];
+		if (--s.holds != 0) return;
+		s = {}; // release text, owner and line index
+		table.unused.push_back((uint16_t)id);
+	}
+	struct Token { // an lexical token, trivially copyable
+		static constexpr uint32_t NOSPELLING = 0xFFFFFFFF;
+
+		uint16_t kind; // token name, id in Symbols()
+		uint16_t source; // id in Sources()
+		uint32_t offset, length; // token contents in source
+		uint32_t spelling; // id in Spellings() for identifiers, NOSPELLING for others
+
+		// tells token name
+		const std::string& Is() const { return Symbols().Get(kind); }
+		// token contents
+		std::string_view Content() const { return Sources().Get(source).substr(offset, length); }
+		// token position in source file, found from offset when asked, -1 for the delimiter
+		int Line() const { return Sources().Position(source, offset).first; }
+		int Column() const { return Sources().Position(source, offset).second; }
+	};
+	// tokens holding the sources they are in, so their contents stay valid as long as the list is kept
+	class TokenList : public std::vector<Token> {
+	public:
+		std::vector<SourceRef> sources;
+
+		// hold a source for tokens in it
+		void Hold(const SourceRef& source) {
+			if (sources.empty() || sources.back().Id() != source.Id()) sources.push_back(source);
+		}
+		// drop tokens and their sources
+		void clear() {
+			std::vector<Token>::clear();
+			sources.clear();
+		}
 	};
 	class Matcher {
 	private:
-		// read a token from file stream
-		bool match(std::istream& ist, Token& token, int& line, int& column) {
-			state* current = at.startState;  // match from start
-			std::string word;
-			char ch;
-			auto it_t = current->trans.begin();
-			decltype(it_t) last_match;
-			int tl = -1, tc = -1;
+		std::vector<uint16_t> kindOf; // token id of table to symbol id
+		uint16_t errKind, endKind; // symbol id of errors and delimiter
+		// a state looping on itself, its run is skipped by ByteScan
+		struct selfLoop {
+			enum { None, Stops, Stay } how = None;
+			unsigned char stops[4]; // Stops: few bytes leaving the state (like a comment body)
+			ByteSet stay; // Stay: bytes staying in the state (like letters and digits of an identifier)
+		};
+		std::vector<selfLoop> loops; // of each state
+		std::vector<char> isHost; // of each token id, tokens of host rules may be reserve words
+		// modes: the dfa of a mode reads tokens from its start, a token may switch the mode for tokens after it
+		std::vector<uint16_t> starts; // of each mode in table
+		std::vector<int> enterOf; // of each token id, mode entered after the token, NONE to stay
+		std::vector<char> isMore; // of each token id, a nameless rule whose text starts the token read after it
+		std::vector<char> fastSpaces; // of each mode, spaces never start a token, so they are skipped by ByteScan
+		std::shared_ptr<LazyDFA> lazy; // states made while scanning instead of table, null for table
+		static constexpr unsigned char spaces[4] = { ' ','\n','\t','\r' };
+		static constexpr size_t MINCHUNK = 1 << 20; // bytes scanned by a thread at least
 
-			while (ist.get(ch)) { // read char
+		// symbol id of a name, kinds are stored in 16 bits
+		static uint16_t symbolId(const std::string& name) {
+			auto id = Symbols().Id(name);
+			if (id > 0xFFFF) throw std::exception("too many token kinds");
+			return (uint16_t)id;
+		}
+		// source of the contents of delimiter
+		static uint16_t endSource() {
+			static const SourceRef source = Sources().Add("#", nullptr, 0, 0);
+			return source.Id();
+		}
+		// text of a file, mapped into memory or read if it can't be mapped, owner keeps it alive; false if the file doesn't exist
+		static bool readFile(const std::string& route, std::string_view& text, std::shared_ptr<const void>& owner) {
+			if (!std::filesystem::exists(route)) {
+				std::cout << "\nsource file not exists\n";
+				return false;
+			}
+			auto mf = std::make_shared<MappedFile>(route);
+			if (!mf->Valid()) { // empty or can't be mapped
+				std::ifstream fin(route, std::ios::binary);
+				auto read = std::make_shared<std::string>(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+				text = *read;
+				owner = read;
+				return true;
+			}
+			text = std::string_view(mf->Data(), mf->Size());
+			owner = mf;
+			return true;
+		}
+		// split source into tokens, offsets are relative to source
+		TokenList scan(std::string_view text, std::shared_ptr<const void> owner, unsigned threads) {
+			auto held = Sources().Add(text, std::move(owner));
+			uint16_t source = held.Id();
+			if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+			threads = (unsigned)std::min<size_t>(threads, text.size() / MINCHUNK); // small sources are not worth threads
+			if (lazy) threads = 1; // states of lazy dfa are made by the one scanning
 
-				if (ch == '\n' || ch == '\r') { // count lines and column
-					line++;
-					column = 0;
+			TokenList tokens;
+			if (threads > 1)
+				scanParallel(source, text, threads, tokens);
+			else {
+				const char* p = text.data(), * end = p + text.size();
+				Token t;
+				int mode = 0;
+				while (match(Spellings(), source, text.data(), p, end, t, mode)) // until end of source
+					tokens.push_back(t);
+			}
+
+			tokens.push_back({ endKind,endSource(),0,1,Token::NOSPELLING }); // push delimiter
+			tokens.Hold(held);
+			return tokens;
+		}
+		// tokens of a chunk, scanned from its start on a guess that a token starts there
+		struct chunk {
+			const char* start, * limit; // scan tokens starting before limit
+			std::vector<Token> tokens;
+			std::vector<int> modes; // each token is read in, kept if the lexer has modes
+			Interner spellings; // of this chunk, ids are made global when stitched
+			const char* stop; // where scanning stopped, a token ends here
+			int stopMode; // mode at stop
+			// filled when stitched
+			std::vector<Token> before; // tokens scanned one by one before the chunk agrees
+			size_t from; // first token taken
+			std::vector<uint32_t> global; // spelling id of chunk to global id
+		};
+		// split source into chunks starting after a newline, scan them at the same time and stitch them
+		// a chunk may start inside a token (like a comment over lines), then tokens are scanned one by one
+		// from the end of the chunk before until both agree on a token, so the result equals scanning in one go
+		// a chunk is scanned from the initial mode, with modes they agree on a token read in the same mode
+		void scanParallel(uint16_t source, std::string_view text, unsigned threads, std::vector<Token>& tokens) {
+			const char* end = text.data() + text.size();
+			std::vector<chunk> chunks(1);
+			chunks.reserve(threads);
+			chunks[0].start = text.data();
+			for (unsigned k = 1; k < threads; k++) {
+				auto nl = (const char*)std::memchr(text.data() + text.size() / threads * k, '\n', text.size() - text.size() / threads * k);
+				if (nl == nullptr) break;
+				if (nl + 1 > chunks.back().start && nl + 1 != end) {
+					chunks.emplace_back();
+					chunks.back().start = nl + 1;
 				}
-				else column++;
+			}
+			for (size_t k = 0; k < chunks.size(); k++)
+				chunks[k].limit = k + 1 < chunks.size() ? chunks[k + 1].start : end;
 
-				if ((it_t = find_if(current->trans.begin(), current->trans.end(), [ch](transition* t) {return t->input == ch; })) != current->trans.end()) { // move
-					// if matched
-					if (tl == tc && tl == -1) { // record first character position
-						tl = line; tc = column;
+			std::vector<std::thread> workers;
+			bool moded = starts.size() > 1;
+			for (auto& c : chunks)
+				workers.emplace_back([this, &c, source, text, end, moded]() {
+					const char* p = c.start;
+					Token t;
+					int mode = 0, before = 0;
+					while (p < c.limit && match(c.spellings, source, text.data(), p, end, t, mode)) {
+						c.tokens.push_back(t);
+						if (moded) c.modes.push_back(before);
+						before = mode;
 					}
+					c.stop = p;
+					c.stopMode = mode;
+					});
+			for (auto& w : workers) w.join();
 
-					word += ch; // append char
-					last_match = it_t;
-					current = (*it_t)->to; // move next
+			// decide what is taken from each chunk, in order
+			const char* q = text.data(); // tokens are exact up to q
+			int qMode = 0; // mode at q
+			Token t;
+			for (auto& c : chunks) {
+				size_t j = 0;
+				bool agree = q == c.start && qMode == 0;
+				while (!agree && q < c.stop) { // scan on until a token is also in chunk
+					int before = qMode;
+					if (!match(Spellings(), source, text.data(), q, end, t, qMode)) break;
+					while (j < c.tokens.size() && c.tokens[j].offset < t.offset) j++;
+					if (j < c.tokens.size() && c.tokens[j].offset == t.offset && (!moded || c.modes[j] == before)) agree = true;
+					else c.before.push_back(t);
 				}
-				else if (word == "" && (ch == ' ' || ch == '\n' || ch == '\t'))continue; // first space char
-				else if (current->is == "numberval" && ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_')) goto err; // number before alphbets
-				else break; // no matched character
+				c.from = agree ? j : c.tokens.size();
+				if (!agree) continue;
+
+				// intern spellings in order of appearance, like in one go
+				c.global.assign(c.spellings.Size(), Token::NOSPELLING);
+				if (c.from == 0) // ids of chunk are in order of appearance
+					for (uint32_t id = 0; id < c.spellings.Size(); id++)
+						c.global[id] = Spellings().Id(c.spellings.Get(id));
+				else
+					for (size_t i = c.from; i < c.tokens.size(); i++) {
+						auto sp = c.tokens[i].spelling;
+						if (sp != Token::NOSPELLING && c.global[sp] == Token::NOSPELLING)
+							c.global[sp] = Spellings().Id(c.spellings.Get(sp));
+					}
+				q = c.stop;
+				qMode = c.stopMode;
 			}
 
-			if (!current->finalState) { // match not finished
-				token = { "","Err",word,0,tl,tc };
-				return true;
+			// copy tokens taken, each chunk by a thread
+			std::vector<size_t> at(chunks.size() + 1, 0);
+			for (size_t k = 0; k < chunks.size(); k++)
+				at[k + 1] = at[k] + chunks[k].before.size() + chunks[k].tokens.size() - chunks[k].from;
+			tokens.resize(at.back());
+			workers.clear();
+			for (size_t k = 0; k < chunks.size(); k++)
+				workers.emplace_back([&c = chunks[k], out = tokens.data() + at[k]]() mutable {
+					out = std::copy(c.before.begin(), c.before.end(), out);
+					for (size_t i = c.from; i < c.tokens.size(); i++, out++) {
+						*out = c.tokens[i];
+						if (out->spelling != Token::NOSPELLING) out->spelling = c.global[out->spelling];
+					}
+					});
+			for (auto& w : workers) w.join();
+		}
+		static bool isSpace(char ch) { return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r'; }
+		static bool isAlpha(char ch) { return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_'; }
+		// start state of a mode
+		int32_t startOf(int mode) {
+			return lazy ? lazy->Start(mode) : starts[mode];
+		}
+		// token id accepted by a dfa state, the lazy dfa has no start state in a mode accepting nothing
+		int acceptOf(int32_t current) const {
+			if (!lazy) return table.accept[current];
+			return current == LazyDFA::DEAD ? LexTable::NONE : lazy->Accept(current);
+		}
+		// no token of a mode starts with a byte
+		bool stops(int mode, char ch) {
+			if (!lazy) return table.Next(starts[mode], ch) == LexTable::DEAD;
+			int32_t start = lazy->Start(mode);
+			return start == LazyDFA::DEAD || lazy->Next(start, ch) == LazyDFA::DEAD;
+		}
+		// skip spaces before a token, a space the lexer can read in the mode (like in a rule of spaces) starts a token
+		void skipSpaces(const char*& p, const char* end, int mode) {
+			for (; p != end && isSpace(*p) && stops(mode, *p); p++)
+				if (fastSpaces[mode] && p + 1 != end && isSpace(p[1])) { // a long run, most are a single space
+					p = ByteScan::Run(p + 1, end, spaces, true);
+					break;
+				}
+		}
+		// longest match, go on from state current until the dfa stops or p reaches end, true if it stopped before end
+		bool advance(uint16_t& current, const char*& p, const char* end) {
+			uint16_t nx;
+			while (p != end && (nx = table.Next(current, *p)) != LexTable::DEAD) {
+				p++;
+				if (nx == current && loops[current].how != selfLoop::None) { // staying in a long run, jump to its end
+					const auto& lp = loops[current];
+					p = lp.how == selfLoop::Stops ? ByteScan::Run(p, end, lp.stops, false) : ByteScan::Run(p, end, lp.stay);
+				}
+				current = nx; // move next
 			}
-			else {
-				if (!(ch == ' ' || ch == '\n' || ch == '\t'))
-					ist.putback(ch); // put back a non-space char
-				token = { "",current->is,word,0,tl,tc };
+			return p != end;
+		}
+		// like advance by lazy dfa, states are made on the way
+		bool advance(int32_t& current, const char*& p, const char* end) {
+			if (current == LazyDFA::DEAD) return p != end; // nothing to read from
+			auto& dfa = *lazy;
+			int32_t nx;
+			while (p != end && (nx = dfa.Next(current, *p)) != LazyDFA::DEAD) {
+				p++;
+				current = nx;
+			}
+			return p != end;
+		}
+		// read a token from p in a mode, which the token may switch; false when only spaces are left
+		bool match(Interner& spellings, uint16_t source, const char* base, const char*& p, const char* end, Token& token, int& mode) {
+			skipSpaces(p, end, mode);
+			if (p == end) return false;
+
+			const char* begin = p;
+			for (;;) {
+				const char* from = p;
+				int accept;
+				if (lazy) {
+					int32_t current = lazy->Start(mode);
+					advance(current, p, end);
+					accept = acceptOf(current);
+				}
+				else {
+					uint16_t current = starts[mode]; // match from start
+					advance(current, p, end);
+					accept = table.accept[current];
+				}
+				if (accept != LexTable::NONE && isMore[accept]) { // the token goes on in the mode entered
+					if (p != from && p != end) {
+						mode = enterOf[accept];
+						continue;
+					}
+					accept = LexTable::NONE; // source ends in the token
+				}
+				emit(accept, spellings, source, base, begin, p, end, token, mode);
 				return true;
 			}
-		err:
-			do // read all alphbets behind
-			{
-				word += ch;
-			} while (ist.get(ch) && ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_'));
-			ist.putback(ch); // revert char
-			token = { "","Err",word,0,tl,tc };
-			return true;
+		}
+		// make token of what the dfa read from begin to p, accept is the token id of the state it stopped in, then switch mode by it
+		// (back to the initial mode for an error)
+		void emit(int accept, Interner& spellings, uint16_t source, const char* base, const char* begin, const char*& p, const char* end, Token& token, int& mode) {
+			if (accept != LexTable::NONE && isHost[accept]) { // may be a reserve word split off the dfa
+				int kw = table.keywords.Find(std::string_view(begin, p - begin), accept);
+				if (kw != KeywordHash::NONE) accept = kw;
+			}
+			if (p != end && numberval != LexTable::NONE && accept == numberval && isAlpha(*p)) { // number before alphbets
+				while (p != end && isAlpha(*p)) p++; // read all alphbets behind
+				accept = LexTable::NONE;
+			}
+			else if (p == begin) p++; // unacceptable character, skip it
+			uint32_t length = (uint32_t)(p - begin);
+			uint32_t spelling = accept == identifier ? spellings.Id(std::string_view(begin, length)) : Token::NOSPELLING;
+			token = { accept == LexTable::NONE ? errKind : kindOf[accept],source,(uint32_t)(begin - base),length,spelling };
+			if (accept == LexTable::NONE) mode = 0; // an error leaves any mode, so a bad or unterminated comment doesn't swallow the source
+			else if (enterOf[accept] != LexTable::NONE) mode = enterOf[accept];
+		}
+		// names of tokens and modes they enter, shared by both kinds of dfa
+		void initKinds(const std::vector<std::string>& modes) {
+			errKind = symbolId("Err");
+			endKind = symbolId("#");
+			for (const auto& k : table.kinds) { // intern token names
+				auto [name, to] = LexTable::SplitKind(k);
+				kindOf.push_back(name.empty() ? errKind : symbolId(name));
+				enterOf.push_back(to.empty() ? LexTable::NONE : LexTable::ModeOf(modes, to));
+				if (!to.empty() && enterOf.back() == LexTable::NONE) throw std::exception("mode not found");
+				isMore.push_back(name.empty() && !to.empty());
+			}
+			isHost.assign(table.kinds.size(), false);
+			for (auto h : table.keywords.hosts)
+				if (h != KeywordHash::NONE) isHost[h] = true;
+		}
+		// table holding only names of tokens
+		static LexTable kindsOnly(const std::vector<std::string>& kinds) {
+			LexTable tb;
+			tb.kinds = kinds;
+			return tb;
 		}
 	public:
-		Automaton at;
-		// add automaton
-		Matcher(const Automaton& automaton) :at(automaton) {}
-		// read given file
-		std::vector<Token> ReadFile(const std::string& route) {
-			if (!std::filesystem::exists(route)) {
-				std::cout << "\nsource file not exists\n";
-				return {};
+		LexTable table;
+		int numberval; // token id of numbers, which can't be followed by alphabets
+		int identifier; // token id of identifiers, whose spellings are interned
+		// add compiled lexer
+		Matcher(const LexTable& table) :table(table), numberval(table.KindOf("numberval")), identifier(table.KindOf("identifier")) {
+			initKinds(table.modes);
+			starts = table.modes.empty() ? std::vector<uint16_t>{ table.start } : table.starts;
+			loops.resize(table.stateCount);
+			for (uint32_t s = 0; s < table.stateCount; s++) {
+				auto& lp = loops[s];
+				int n = 0; // bytes leaving
+				for (int ch = 0; ch < 256; ch++)
+					if (table.Next((uint16_t)s, (unsigned char)ch) == s) lp.stay.Add((unsigned char)ch);
+					else {
+						if (n < 4) lp.stops[n] = (unsigned char)ch;
+						n++;
+					}
+				if (n == 256) continue; // no loop
+				if (n == 0 || n > 4) {
+					lp.how = selfLoop::Stay;
+					continue;
+				}
+				for (int i = n; i < 4; i++) lp.stops[i] = lp.stops[0]; // fill unused by a repeat
+				lp.how = selfLoop::Stops; // comparing a few bytes is cheaper than lookup
 			}
-			std::vector<Token> tokens;
-			std::ifstream fin(route); // open file
-			Token t;
-			int line = 1, column = 0;
-			while (fin.peek() != EOF) // until end of file
-			{
-				if (match(fin, t, line, column)) { // get a token
-					tokens.push_back(t);
+			for (auto st : starts) {
+				fastSpaces.push_back(true);
+				for (auto ch : spaces)
+					if (table.Next(st, ch) != LexTable::DEAD) fastSpaces.back() = false;
+			}
+		}
+		// add automaton, compiled to table form
+		Matcher(const Automaton& automaton) :Matcher(LexTable::Compile(automaton)) {}
+		// add lazy dfa, its states are made while scanning, so sources are scanned by one thread
+		Matcher(const LazyDFA& dfa) :table(kindsOnly(dfa.Kinds())), numberval(table.KindOf("numberval")), identifier(table.KindOf("identifier")) {
+			initKinds(dfa.Modes());
+			lazy = std::make_shared<LazyDFA>(dfa);
+			for (size_t m = 0; m < std::max<size_t>(1, dfa.Modes().size()); m++) {
+				fastSpaces.push_back(true);
+				for (auto ch : spaces)
+					if (!stops((int)m, ch)) fastSpaces.back() = false;
+			}
+		}
+		// split source (4 GB at most) into tokens, source must live as long as the tokens
+		// a large source is split among threads (0 for all cores), tokens are the same as scanned by one
+		TokenList Scan(std::string_view source, unsigned threads = 1) {
+			return scan(source, nullptr, threads);
+		}
+		// read all of a stream (like std::cin), kept for the tokens
+		TokenList ScanStream(std::istream& ist, unsigned threads = 1) {
+			auto text = std::make_shared<std::string>(std::istreambuf_iterator<char>(ist), std::istreambuf_iterator<char>());
+			return scan(*text, text, threads);
+		}
+		// read given file, mapped into memory and kept for the tokens
+		TokenList ScanFile(const std::string& route, unsigned threads = 1) {
+			std::string_view text;
+			std::shared_ptr<const void> owner;
+			if (!readFile(route, text, owner)) return {};
+			return scan(text, std::move(owner), threads);
+		}
+		// tokens of a source read one at a time as they are asked for, so lexing goes along with parsing
+		// and no token list is held; tokens are the same as Scan by one thread, ending with the delimiter
+		// the matcher must live as long as the stream, tokens are valid while the stream or its Source is held
+		class TokenStream {
+		private:
+			Matcher* matcher;
+			SourceRef source;
+			const char* base, * p, * end;
+			int mode = 0; // of the lexer
+			bool ended = false; // delimiter given
+		public:
+			TokenStream(Matcher& matcher, std::string_view text, std::shared_ptr<const void> owner)
+				:matcher(&matcher), source(Sources().Add(text, std::move(owner))), base(text.data()), p(base), end(base + text.size()) {}
+			// read next token, false after the delimiter
+			bool Next(Token& token) {
+				if (ended) return false;
+				if (!matcher->match(Spellings(), source.Id(), base, p, end, token, mode)) {
+					token = { matcher->endKind,endSource(),0,1,Token::NOSPELLING };
+					ended = true;
 				}
+				return true;
 			}
+			const SourceRef& Source() const {
+				return source;
+			}
+		};
+		// lexer fed by chunks of a source of any size as they arrive (like from a pipe), a token is given once the byte
+		// after it is fed, the dfa state of a token cut by a chunk is kept so nothing is scanned again;
+		// tokens are the same as scanning the whole source however it is cut
+		// bytes are kept in blocks added to Sources() with the position of their first byte, a token cut by a full block
+		// is copied to the next one; the lexer holds only the block it reads and tokens given hold theirs (see TokenList),
+		// so a block is freed once the lexer moved on and the tokens in it are dropped
+		// the matcher must live as long as the lexer
+		class ChunkLexer {
+		private:
+			static constexpr size_t BLOCK = 1 << 20; // bytes of a block at least
+			Matcher* matcher;
+			std::shared_ptr<std::vector<char>> block;
+			SourceRef source; // of block
+			size_t size = 0, at = 0; // bytes fed to block, and scanned
+			enum { Between, InToken, AlphaTail } mode = Between; // AlphaTail: alphabets behind a number
+			size_t begin = 0; // in block, of the token read
+			size_t part = 0; // in block, where the dfa began reading, after begin if the token went on in a mode entered
+			int32_t current = 0; // dfa state of the token read
+			int lexMode = 0; // mode of the lexer
+			int line = 1, column = 1; // of the first byte of block
 
-			tokens.push_back({ "","#","#",0,-1,-1 }); // push delimiter
-			return tokens;
+			// move to a new block taking at least need bytes, the token read is copied to its start
+			void newBlock(size_t need) {
+				size_t keep = mode == Between ? size : begin; // bytes no longer needed
+				auto next = std::make_shared<std::vector<char>>(std::max(BLOCK, (size - keep) * 2 + need));
+				if (block) {
+					std::vector<uint32_t> starts; // of lines in bytes dropped, for the position of the first byte kept
+					ByteScan::Lines(block->data(), 0, keep, starts);
+					line += (int)starts.size();
+					column = starts.empty() ? column + (int)keep : (int)(keep - starts.back()) + 1;
+					std::copy(block->begin() + keep, block->begin() + size, next->begin());
+				}
+				size -= keep;
+				at -= keep;
+				begin -= std::min(begin, keep);
+				part -= std::min(part, keep);
+				block = std::move(next);
+				source = Sources().Add(std::string_view(block->data(), size), block, line, column);
+			}
+			// scan fed bytes of block, tokens ended are added to tokens
+			void scan(TokenList& tokens) {
+				auto& mc = *matcher;
+				size_t given = tokens.size();
+				const char* base = block->data(), * p = base + at, * end = base + size;
+				Token t;
+				while (p != end) {
+					if (mode == Between) {
+						mc.skipSpaces(p, end, lexMode);
+						if (p == end) break;
+						begin = part = p - base;
+						current = mc.startOf(lexMode);
+						mode = InToken;
+					}
+					if (mode == InToken) {
+						bool stopped;
+						if (mc.lazy) stopped = mc.advance(current, p, end);
+						else {
+							uint16_t s = (uint16_t)current;
+							stopped = mc.advance(s, p, end);
+							current = s;
+						}
+						if (!stopped) break; // token may go on in next chunk
+						int accept = mc.acceptOf(current);
+						if (accept != LexTable::NONE && mc.isMore[accept]) { // the token goes on in the mode entered
+							if (p != base + part) {
+								lexMode = mc.enterOf[accept];
+								part = p - base;
+								current = mc.startOf(lexMode);
+								continue;
+							}
+							accept = LexTable::NONE;
+						}
+						if (mc.numberval == LexTable::NONE || accept != mc.numberval || !isAlpha(*p)) {
+							mc.emit(accept, Spellings(), source.Id(), base, base + begin, p, end, t, lexMode);
+							tokens.push_back(t);
+							mode = Between;
+							continue;
+						}
+						mode = AlphaTail; // number before alphabets
+					}
+					while (p != end && isAlpha(*p)) p++; // read all alphabets behind
+					if (p == end) break;
+					mc.emit(LexTable::NONE, Spellings(), source.Id(), base, base + begin, p, end, t, lexMode);
+					tokens.push_back(t);
+					mode = Between;
+				}
+				at = p - base;
+				if (tokens.size() != given) tokens.Hold(source);
+			}
+		public:
+			ChunkLexer(Matcher& matcher) :matcher(&matcher) {}
+			// feed next bytes of source, tokens ended are added to tokens
+			void Feed(std::string_view chunk, TokenList& tokens) {
+				while (!chunk.empty()) {
+					if (!block || size == block->size()) newBlock(std::min(chunk.size(), BLOCK));
+					size_t n = std::min(chunk.size(), block->size() - size);
+					std::memcpy(block->data() + size, chunk.data(), n);
+					size += n;
+					chunk.remove_prefix(n);
+					Sources().Grow(source.Id(), std::string_view(block->data(), size));
+					scan(tokens);
+				}
+			}
+			// end of source, the token read and the delimiter are added to tokens
+			void Finish(TokenList& tokens) {
+				auto& mc = *matcher;
+				if (mode != Between) {
+					const char* base = block->data(), * p = base + size;
+					int accept = mode == AlphaTail ? LexTable::NONE : mc.acceptOf(current);
+					if (accept != LexTable::NONE && mc.isMore[accept]) accept = LexTable::NONE; // source ends in the token
+					Token t;
+					mc.emit(accept, Spellings(), source.Id(), base, base + begin, p, p, t, lexMode);
+					tokens.push_back(t);
+					tokens.Hold(source);
+					mode = Between;
+				}
+				tokens.push_back({ mc.endKind,endSource(),0,1,Token::NOSPELLING });
+			}
+		};
+		// stream tokens of a source, source must live as long as the tokens
+		TokenStream Stream(std::string_view source) {
+			return TokenStream(*this, source, nullptr);
+		}
+		// stream tokens of given file, mapped into memory and kept for the tokens, a missing file gives only the delimiter
+		TokenStream StreamFile(const std::string& route) {
+			std::string_view text;
+			std::shared_ptr<const void> owner;
+			readFile(route, text, owner);
+			return TokenStream(*this, text, std::move(owner));
 		}
 	};
 	// print tokens
 	void PrintTokens(std::vector<Token>& tokens) {
 		for (const auto& t : tokens) {
-			if (t.is == "Err")
-				std::cout << "Err: unacceptable character sequence \"" << t.content << "\",\n at: line " << t.line << " column " << t.column << "\n";
-			else std::cout << "Name: " << t.is << "\n Content: " << t.content << ",\n at: line " << t.line << " column " << t.column << "\n";
+			if (t.Is() == "Err")
+				std::cout << "Err: unacceptable character sequence \"" << t.Content() << "\",\n at: line " << t.Line() << " column " << t.Column() << "\n";
+			else std::cout << "Name: " << t.Is() << "\n Content: " << t.Content() << ",\n at: line " << t.Line() << " column " << t.Column() << "\n";
 		}
 	}
 }
\ No newline at end of file
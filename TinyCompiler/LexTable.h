@@ -0,0 +1,281 @@
+#pragma once
+#include<vector>
+#include<array>
+#include<string>
+#include<map>
+#include<queue>
+#include<cstdint>
+#include<memory>
+#include<set>
+#include<string_view>
+#include<algorithm>
+
+#include"Automaton.h"
+
+namespace hscp {
+	// fnv-1a of bytes, continued from h
+	inline uint64_t Fnv1a(const void* data, size_t n, uint64_t h = 14695981039346656037ull) {
+		auto p = (const unsigned char*)data;
+		for (size_t i = 0; i < n; i++) {
+			h ^= p[i];
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+
+	// reserve words found by a perfect hash after a match of their host rule (like identifier), instead of by dfa states
+	// hash and displace: a word is hashed once, goes to a bucket by the hash, then to a slot by the hash mixed with the seed of its bucket,
+	// no two words share a slot
+	struct KeywordHash {
+		static constexpr int NONE = -1;
+		struct keyword {
+			std::string word;
+			int kind, host; // token id of word and of its host rule
+		};
+
+		uint64_t lengths = 0; // bit n is set if a word has length n, longer ones set bit 63
+		std::vector<uint32_t> seeds; // of each bucket
+		std::vector<std::string> words; // of each slot, empty if unused
+		std::vector<int32_t> kinds, hosts; // of each slot, NONE if unused
+
+		static uint64_t Hash(std::string_view s) {
+			return Fnv1a(s.data(), s.size());
+		}
+		// slot of a hash by a seed, mixed so seeds give unrelated slots
+		static size_t Slot(uint64_t h, uint32_t seed, size_t slots) {
+			h ^= seed * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 31;
+			h *= 0xBF58476D1CE4E5B9ull;
+			return (size_t)((h ^ (h >> 32)) % slots);
+		}
+		static uint64_t LengthBit(size_t n) {
+			return 1ull << (n < 63 ? n : 63);
+		}
+		bool Empty() const {
+			return words.empty();
+		}
+		// token id of a reserve word read as host rule, NONE if it is not one
+		int Find(std::string_view s, int host) const {
+			if ((lengths & LengthBit(s.size())) == 0) return NONE; // most names are cut here without hashing
+			uint64_t h = Hash(s);
+			size_t slot = Slot(h, seeds[(size_t)(h >> 32) % seeds.size()], words.size());
+			return hosts[slot] == host && words[slot] == s ? kinds[slot] : NONE;
+		}
+		// find a seed for each bucket, biggest buckets first, slots grow if a bucket can't be placed
+		static KeywordHash Build(const std::vector<keyword>& keys) {
+			KeywordHash kh;
+			std::vector<const keyword*> unique;
+			std::set<std::string> seen;
+			for (const auto& k : keys) // a word defined again never wins
+				if (seen.insert(k.word).second) unique.push_back(&k);
+			if (unique.empty()) return kh;
+			for (auto k : unique)
+				kh.lengths |= LengthBit(k->word.size());
+
+			size_t n = unique.size(), slots = n + n / 4;
+			std::vector<std::vector<const keyword*>> buckets((n + 1) / 2);
+			for (auto k : unique)
+				buckets[(size_t)(Hash(k->word) >> 32) % buckets.size()].push_back(k);
+			std::vector<size_t> order(buckets.size());
+			for (size_t b = 0; b < order.size(); b++) order[b] = b;
+			std::stable_sort(order.begin(), order.end(), [&buckets](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+			for (;; slots += slots / 8 + 1) {
+				kh.seeds.assign(buckets.size(), 0);
+				kh.words.assign(slots, "");
+				kh.kinds.assign(slots, NONE);
+				kh.hosts.assign(slots, NONE);
+				bool placed = true;
+				for (auto b : order) {
+					if (buckets[b].empty()) continue;
+					std::vector<size_t> at;
+					uint32_t seed = 1;
+					for (; seed < (1u << 16); seed++) { // try seeds until words of bucket go to free and different slots
+						at.clear();
+						for (auto k : buckets[b]) {
+							size_t slot = Slot(Hash(k->word), seed, slots);
+							if (kh.kinds[slot] != NONE || std::find(at.begin(), at.end(), slot) != at.end()) break;
+							at.push_back(slot);
+						}
+						if (at.size() == buckets[b].size()) break;
+					}
+					if (at.size() != buckets[b].size()) {
+						placed = false;
+						break;
+					}
+					kh.seeds[b] = seed;
+					for (size_t i = 0; i < at.size(); i++) {
+						kh.words[at[i]] = buckets[b][i]->word;
+						kh.kinds[at[i]] = buckets[b][i]->kind;
+						kh.hosts[at[i]] = buckets[b][i]->host;
+					}
+				}
+				if (placed) return kh;
+			}
+		}
+	};
+	// compiled lexer: dfa states renumbered 0..N-1 with a dense transition table indexed by byte class
+	// the table only refers to its arrays, which are owned by storage (built in memory, or a mapped cache file)
+	// a lexer with modes (start conditions) has a dfa of each mode in the table, each from its own start state
+	struct LexTable {
+		static constexpr uint16_t DEAD = 0xFFFF; // no transition
+		static constexpr int NONE = -1; // not a final state
+
+		uint32_t stateCount = 0;
+		uint32_t classCount = 0;
+		uint16_t start = 0; // start state, always 0 after compile
+		const unsigned char* classOf = nullptr; // byte to class id, 256 entries
+		const uint16_t* next = nullptr; // next[state * classCount + class]
+		const int32_t* accept = nullptr; // token id accepted by each state, NONE if not final
+		std::vector<std::string> kinds; // token id to its lexical meaning
+		std::vector<std::string> modes; // names of modes, the initial one first; empty if the lexer has one mode
+		std::vector<uint16_t> starts; // start state of each mode, empty with modes
+		KeywordHash keywords; // reserve words left out of the dfa
+		std::shared_ptr<const void> storage; // keeps arrays above alive, shared by copies
+
+		// move from state s by a byte
+		uint16_t Next(uint16_t s, unsigned char ch) const {
+			return next[(size_t)s * classCount + classOf[ch]];
+		}
+		// token id of a lexical meaning, NONE if the lexer never produces it
+		int KindOf(const std::string& is) const {
+			for (size_t i = 0; i < kinds.size(); i++)
+				if (kinds[i] == is) return (int)i;
+			return NONE;
+		}
+		// token name and the mode entered after it, a lexical meaning switching mode is "name mode"
+		// mode is empty if the token stays in its mode, name is empty if the text only starts the next token
+		static std::pair<std::string, std::string> SplitKind(const std::string& is) {
+			auto sp = is.find(' ');
+			if (sp == std::string::npos) return { is, "" };
+			return { is.substr(0, sp), is.substr(sp + 1) };
+		}
+		// index of a mode in modes, the initial mode is 0 even if the lexer has one mode; NONE if not found
+		static int ModeOf(const std::vector<std::string>& modes, const std::string& name) {
+			auto it = std::find(modes.begin(), modes.end(), name);
+			if (it != modes.end()) return (int)(it - modes.begin());
+			return modes.empty() && name == "initial" ? 0 : NONE;
+		}
+
+		// arrays of a table built in memory
+		struct tableData {
+			std::array<unsigned char, 256> classOf{};
+			std::vector<uint16_t> next;
+			std::vector<int32_t> accept;
+		};
+		// own arrays built in memory
+		void Adopt(std::shared_ptr<tableData> data) {
+			classOf = data->classOf.data();
+			next = data->next.data();
+			accept = data->accept.data();
+			storage = std::move(data);
+		}
+
+		// compile a dfa to table form
+		static LexTable Compile(const Automaton& dfa) {
+			LexTable tb;
+			auto data = std::make_shared<tableData>();
+			auto bc = ByteClasses::Split(dfa.transitions); // columns of the table
+			data->classOf = bc.classOf;
+			tb.classCount = (uint32_t)bc.Count();
+			if (dfa.startState == NOSTATE) { // empty automaton accepts nothing
+				tb.stateCount = 1;
+				data->next.assign(tb.classCount, DEAD);
+				data->accept.assign(1, NONE);
+				tb.Adopt(std::move(data));
+				return tb;
+			}
+
+			std::vector<uint32_t> number(dfa.states.size(), NOSTATE); // dfa state to table state
+			std::map<std::string, int> kindno; // lexical meaning to token id
+			std::vector<uint32_t> order; // table state to dfa state
+			std::queue<uint32_t> q;
+
+			// number states reachable from start in bfs order, start gets 0
+			auto visit = [&](uint32_t s) {
+				if (number[s] != NOSTATE) return;
+				if (order.size() >= DEAD) throw std::exception("too many states for lexer table");
+				number[s] = (uint32_t)order.size();
+				order.push_back(s);
+				q.push(s);
+			};
+			visit(dfa.startState);
+			while (!q.empty()) {
+				auto s = q.front(); q.pop();
+				dfa.EachTransition(s, [&visit](const transition& t) {
+					if (t.input != 0) visit(t.to); // ignore epsilon
+					});
+			}
+
+			tb.stateCount = (uint32_t)order.size();
+			data->next.assign((size_t)tb.stateCount * tb.classCount, DEAD);
+			data->accept.assign(tb.stateCount, NONE);
+			for (uint32_t i = 0; i < tb.stateCount; i++) {
+				const auto& s = dfa.states[order[i]];
+				dfa.EachTransition(order[i], [&tb, &data, &number, i](const transition& t) {
+					if (t.input == 0) return;
+					for (int c = data->classOf[t.input.from]; c <= data->classOf[t.input.to]; c++) // fill every class in range
+						data->next[(size_t)i * tb.classCount + c] = (uint16_t)number[t.to];
+					});
+				if (s.finalState) { // record token id
+					auto it = kindno.find(s.is);
+					if (it == kindno.end()) {
+						it = kindno.emplace(s.is, (int)tb.kinds.size()).first;
+						tb.kinds.push_back(s.is);
+					}
+					data->accept[i] = it->second;
+				}
+			}
+			tb.Adopt(std::move(data));
+			return tb;
+		}
+		// join compiled lexers of modes into one, mode m starts where tables[m] does
+		// a class of the joined table is the bytes in one class of every table, token ids of the first table
+		// are kept with its reserve words, reserve words of other modes are dropped (rules of [reserve] are initial)
+		static LexTable Join(const std::vector<LexTable>& tables, const std::vector<std::string>& modes) {
+			LexTable tb;
+			auto data = std::make_shared<tableData>();
+			std::map<std::vector<unsigned char>, int> classOfKey; // classes in each table to joined class
+			std::vector<unsigned char> sample; // a byte of each joined class
+			for (int ch = 0; ch < 256; ch++) {
+				std::vector<unsigned char> key;
+				for (const auto& t : tables) key.push_back(t.classOf[ch]);
+				auto it = classOfKey.emplace(key, (int)sample.size()).first;
+				if (it->second == (int)sample.size()) sample.push_back((unsigned char)ch);
+				data->classOf[ch] = (unsigned char)it->second;
+			}
+			tb.classCount = (uint32_t)sample.size();
+			for (const auto& t : tables) tb.stateCount += t.stateCount;
+			if (tb.stateCount >= DEAD) throw std::exception("too many states for lexer table");
+			tb.kinds = tables[0].kinds;
+			tb.keywords = tables[0].keywords;
+			data->next.assign((size_t)tb.stateCount * tb.classCount, DEAD);
+			data->accept.assign(tb.stateCount, NONE);
+			uint32_t base = 0; // first state of a table in joined one
+			for (const auto& t : tables) {
+				std::vector<int32_t> kindOf; // token id of table to joined one
+				for (const auto& k : t.kinds) {
+					int id = tb.KindOf(k);
+					if (id == NONE) {
+						id = (int)tb.kinds.size();
+						tb.kinds.push_back(k);
+					}
+					kindOf.push_back(id);
+				}
+				for (uint32_t s = 0; s < t.stateCount; s++) {
+					for (uint32_t c = 0; c < tb.classCount; c++) {
+						auto nx = t.Next((uint16_t)s, sample[c]);
+						data->next[(size_t)(base + s) * tb.classCount + c] = nx == DEAD ? DEAD : (uint16_t)(nx + base);
+					}
+					data->accept[base + s] = t.accept[s] == NONE ? NONE : kindOf[t.accept[s]];
+				}
+				tb.starts.push_back((uint16_t)(base + t.start));
+				base += t.stateCount;
+			}
+			tb.start = tb.starts[0];
+			tb.modes = modes;
+			tb.Adopt(std::move(data));
+			return tb;
+		}
+	};
+}
\ No newline at end of file
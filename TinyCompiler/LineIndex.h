@@ -0,0 +1,39 @@
+#pragma once
+#include<vector>
+#include<string_view>
+#include<algorithm>
+#include<cstdint>
+
+#include"ByteScan.h"
+
+namespace hscp {
+	// start of each line of a text, found by a vectorized newline scan, so the line and column of an offset is a binary search
+	// tokens keep only offsets, their positions are looked up here when a message needs them
+	class LineIndex {
+	private:
+		std::vector<uint32_t> starts{ 0 }; // offset of the first byte of each line
+		size_t scanned = 0; // bytes of text whose newlines are in starts
+	public:
+		LineIndex() = default;
+		explicit LineIndex(std::string_view text) {
+			Extend(text);
+		}
+		// add newlines of text past the bytes scanned before, for a text fed in pieces
+		void Extend(std::string_view text) {
+			if (text.size() <= scanned) return;
+			ByteScan::Lines(text.data(), scanned, text.size(), starts);
+			scanned = text.size();
+		}
+		// line of an offset, from 1
+		int Line(uint32_t offset) const {
+			return (int)(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin());
+		}
+		// column of an offset in its line, from 1
+		int Column(uint32_t offset) const {
+			return (int)(offset - starts[Line(offset) - 1]) + 1;
+		}
+		size_t Lines() const {
+			return starts.size();
+		}
+	};
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include<string>
+#include<cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include<windows.h>
+#else
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<unistd.h>
+#endif
+
+namespace hscp {
+	// a file mapped read-only into memory, unmapped when destroyed
+	class MappedFile {
+	private:
+		const char* data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE, mapping = NULL;
+#endif
+		// release mapping
+		void close() {
+#ifdef _WIN32
+			if (data != nullptr) UnmapViewOfFile(data);
+			if (mapping != NULL) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+			mapping = NULL;
+#else
+			if (data != nullptr) munmap((void*)data, size);
+#endif
+			data = nullptr;
+			size = 0;
+		}
+	public:
+		MappedFile() {}
+		// map a whole file, check Valid() for result
+		MappedFile(const std::string& route) {
+#ifdef _WIN32
+			file = CreateFileA(route.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE) return;
+			LARGE_INTEGER len;
+			if (!GetFileSizeEx(file, &len) || len.QuadPart == 0) { close(); return; } // empty file can't be mapped
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping == NULL) { close(); return; }
+			data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (data == nullptr) { close(); return; }
+			size = (size_t)len.QuadPart;
+#else
+			int fd = open(route.c_str(), O_RDONLY);
+			if (fd < 0) return;
+			struct stat st;
+			if (fstat(fd, &st) == 0 && st.st_size > 0) { // empty file can't be mapped
+				void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p != MAP_FAILED) {
+					data = (const char*)p;
+					size = (size_t)st.st_size;
+				}
+			}
+			::close(fd); // mapping stays valid after closing
+#endif
+		}
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile() {
+			close();
+		}
+
+		bool Valid() const { return data != nullptr; }
+		const char* Data() const { return data; }
+		size_t Size() const { return size; }
+	};
+}
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include<bitset>
 #include<map>
 #include<stack>
+#include<string>
+#include<algorithm>
 
 #include"Vlpp.h"
 namespace hscp {
@@ -28,9 +30,11 @@ namespace hscp {
 	public:
 		CharRange chr; // base char
 		bool escaped; // if it's a escaped character
+		int ref = -1; // index of a referred expression (quoted by '`'), which is an operand
+		int min = 0, max = 0; // counts of a repetition '{', max is -1 for no bound
 
 		regextok(unsigned char c, bool esc = false) :chr(c), escaped(esc) {}
-		regextok(unsigned char from, unsigned char to) :chr(from, to), escaped(false) {}
+		regextok(unsigned char from, unsigned char to) :chr(from, to), escaped(true) {} // a range is an operand, even of one operator char
 		regextok(const CharRange& chr) :chr(chr), escaped(false) {}
 		bool operator==(char c) const { // compare with reserve character to know if the char is a operator
 			return !escaped && chr == c;
@@ -45,6 +49,8 @@ namespace hscp {
 	};
 
 	class RegexProcesser {
+	public:
+		static constexpr int REPEAT_MAX = 1000; // bound of a repetition count, each repeat is a copy of the operand
 	private:
 		
 		// process escaped chars
@@ -91,13 +97,43 @@ namespace hscp {
 			}
 			return std::move(toks);
 		}
-		// convert single character to a token
-		static std::vector<regextok> tokenize(const std::string& regex) {
+		// read a repetition {m}, {m,} or {m,n} from '{', i is left at '}'
+		static regextok repetition(std::string::const_iterator& i, std::string::const_iterator end) {
+			auto count = [&i, end]() { // -1 if no digit
+				int n = -1;
+				for (; i != end && *i >= '0' && *i <= '9'; ++i) {
+					n = (n == -1 ? 0 : n * 10) + (*i - '0');
+					if (n > REPEAT_MAX) throw std::exception("repetition count too large");
+				}
+				return n;
+			};
+			regextok t('{');
+			++i;
+			t.min = t.max = count();
+			if (i != end && *i == ',') { // {m,} or {m,n}
+				++i;
+				t.max = count();
+			}
+			if (i == end || *i != '}' || t.min == -1 || t.max == 0 || (t.max != -1 && t.max < t.min))
+				throw std::exception("invalid repetition");
+			return t;
+		}
+		// convert single character to a token, names referred are added to refs if given, else '`' is a char
+		static std::vector<regextok> tokenize(const std::string& regex, std::vector<std::string>* refs) {
 			std::vector<regextok> toks;
 			std::vector<regextok> rangetoks;
 			
+			bool inRange = false; // '{' in a range is a char
 			for (auto i = regex.begin(); i != regex.end(); ++i) { // for each character
-				if (*i == '\\') { // is escape char
+				if (refs != nullptr && *i == '`') { // referrence
+					auto close = std::find(i + 1, regex.end(), '`');
+					if (close == regex.end()) throw std::exception("invalid referrence symbol");
+					toks.emplace_back(0, true);
+					toks.back().ref = (int)refs->size();
+					refs->emplace_back(i + 1, close);
+					i = close;
+				}
+				else if (*i == '\\') { // is escape char
 					auto ts = escapeChar(*(i + 1));
 					std::move(ts.begin(), ts.end(), back_inserter(toks));
 					++i;
@@ -106,8 +142,13 @@ namespace hscp {
 					std::vector<regextok> ts = { '[','^',']' };
 					std::move(ts.begin(), ts.end(), back_inserter(toks));
 				}
-				else
+				else if (*i == '{' && !inRange) // repetition
+					toks.push_back(repetition(i, regex.end()));
+				else {
+					if (*i == '[') inRange = true;
+					else if (*i == ']') inRange = false;
 					toks.emplace_back(*i);
+				}
 			}
 
 			// process range syntax [...]
@@ -201,6 +242,16 @@ namespace hscp {
 					pushOp(*i);
 					continue;
 				}
+				if ((*i) == '{') { // repetition, bound to the operand before as closures are
+					if (!last_char) throw std::exception("invalid repetition"); // nothing to repeat, at start or after '(' or '|'
+					while (!ops.empty() && priority.at(ops.top()) >= priority.at('*')) {
+						res.push_back(ops.top());
+						ops.pop();
+					}
+					res.push_back(*i);
+					last_char = true;
+					continue;
+				}
 				if ((*i) == '|') { // or
 					last_char = false;
 					pushOp(*i);
@@ -248,8 +299,59 @@ namespace hscp {
 
 	public:
 		// process expression to regex token stream (post fix)
-		static std::vector<regextok> ProcessRegex(const std::string& regex) {
-			return toPost(tokenize(regex));
+		// with refs, a name quoted by '`' is a token referring to refs[ref] (see RegexAst::Parse)
+		static std::vector<regextok> ProcessRegex(const std::string& regex, std::vector<std::string>* refs = nullptr) {
+			return toPost(tokenize(regex, refs));
+		}
+	};
+
+	// node of regex syntax tree
+	struct RegexNode {
+		enum Type { Leaf, Concat, Alter, Star, Plus, Optional, Repeat } type;
+		CharRange chr = 0; // input of leaf
+		int left = -1, right = -1; // children, unary operators only use left
+		int ref = -1; // leaf referring to an expression, see regextok
+		int min = 0, max = 0; // counts of Repeat, max is -1 for no bound
+	};
+	// regex syntax tree, nodes live in one arena and children always come before parents
+	struct RegexTree {
+		std::vector<RegexNode> nodes;
+		int root = -1;
+
+		// add a node
+		int NewNode(RegexNode::Type type, int left = -1, int right = -1, CharRange chr = 0) {
+			nodes.push_back({ type, chr, left, right });
+			return (int)nodes.size() - 1;
+		}
+		// build tree from postfix regex
+		static RegexTree FromPostfix(const std::vector<regextok>& regex) {
+			RegexTree tree;
+			std::stack<int> subs; // a stack for subtrees
+			int l, r;
+			for (auto i = regex.begin(); i != regex.end(); ++i) {
+				if (*i == '|' || *i == '&') { // binary operators
+					r = subs.top(); subs.pop();
+					l = subs.top(); subs.pop();
+					subs.push(tree.NewNode(*i == '|' ? RegexNode::Alter : RegexNode::Concat, l, r));
+				}
+				else if (*i == '*' || *i == '+' || *i == '?') { // closures
+					l = subs.top(); subs.pop();
+					subs.push(tree.NewNode(*i == '*' ? RegexNode::Star : *i == '+' ? RegexNode::Plus : RegexNode::Optional, l));
+				}
+				else if (*i == '{') { // repetition
+					if (subs.empty()) throw std::exception("invalid repetition"); // of nothing, like (){2}
+					l = subs.top(); subs.pop();
+					subs.push(tree.NewNode(RegexNode::Repeat, l));
+					tree.nodes.back().min = i->min;
+					tree.nodes.back().max = i->max;
+				}
+				else { // normal character or referrence
+					subs.push(tree.NewNode(RegexNode::Leaf, -1, -1, *i));
+					tree.nodes.back().ref = i->ref;
+				}
+			}
+			tree.root = subs.top(); // the subtree left is whole expression
+			return tree;
 		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,286 @@
+#pragma once
+#include<vector>
+#include<string>
+#include<array>
+#include<map>
+#include<unordered_map>
+#include<algorithm>
+#include<cstdint>
+
+#include"RegExpParser.h"
+
+namespace hscp {
+	// regex syntax tree with n-ary concatenation and alternation, simplified while it is built:
+	// nested concatenations and alternations are flattened, single chars and ranges alternated become one set,
+	// alternatives sharing a prefix are factored (if|int|in -> i(f|n(t)?)), x x* becomes x+ and closures of closures one closure
+	// equal subtrees are made once, so a subtree is equal to another when their ids are
+	struct RegexAst {
+		enum Type { Set, Concat, Alter, Star, Plus, Optional };
+		using bytes = std::array<uint64_t, 4>; // bit of each byte
+		struct node {
+			Type type;
+			bytes set; // of Set
+			std::vector<int> kids; // operands, in order
+			uint64_t size = 0; // sets when expanded to a tree (see ToTree), a shared node counts at each use
+		};
+		static constexpr uint64_t EXPAND_MAX = 1 << 11; // sets of a rule expanded, so repeats nested can't blow up building
+		std::vector<node> nodes;
+		int root = -1;
+
+		// id of an operator node simplified, made if new
+		int Make(Type type, const std::vector<int>& kids) {
+			switch (type)
+			{
+			case Concat: {
+				auto out = concat(kids);
+				return out.size() == 1 ? out[0] : intern(Concat, std::move(out), {});
+			}
+			case Alter: return alter(kids);
+			default: return closure(type, kids[0]);
+			}
+		}
+		// set of bytes, byte 0 stands for epsilon and is never in a set
+		int MakeSet(CharRange chr) {
+			bytes set{};
+			for (int ch = std::max<int>(chr.from, 1); ch <= chr.to; ch++) set[ch >> 6] |= 1ull << (ch & 63);
+			return intern(Set, {}, set);
+		}
+		// body repeated min to max times (max -1 for no bound), copies share the body node:
+		// x{2,} -> x x+, x{2,4} -> x x (x (x)?)?, nested so a dfa state counts the copies matched and stays minimal
+		// copies are expanded when built, so the sets of all copies are bounded by EXPAND_MAX, like (x{100}){100}
+		int Repeat(int body, int min, int max) {
+			if (nodes[body].size * (uint64_t)std::max(min, max) > EXPAND_MAX) throw std::exception("repetition count too large");
+			std::vector<int> seq;
+			if (max == -1) {
+				if (min == 0) return closure(Star, body);
+				seq.assign(min - 1, body);
+				seq.push_back(closure(Plus, body));
+			}
+			else {
+				seq.assign(min, body);
+				int tail = -1;
+				for (int k = min; k < max; k++) tail = closure(Optional, tail == -1 ? body : Make(Concat, { body, tail }));
+				if (tail != -1) seq.push_back(tail);
+			}
+			return Make(Concat, seq);
+		}
+		// continuous bytes of a set
+		static std::vector<CharRange> Ranges(const bytes& set) {
+			auto has = [&set](int ch) { return (set[ch >> 6] >> (ch & 63) & 1) != 0; };
+			std::vector<CharRange> ranges;
+			for (int ch = 1; ch < 256; ch++) {
+				if ((set[ch >> 6] >> (ch & 63)) == 0) ch |= 63; // no more in this word
+				if (!has(ch)) continue;
+				int from = ch;
+				while (ch + 1 < 256 && has(ch + 1)) ch++;
+				ranges.emplace_back((unsigned char)from, (unsigned char)ch);
+			}
+			return ranges;
+		}
+		// copy subtree n of another tree into this one, nodes shared there are copied once
+		int Import(const RegexAst& from, int n) {
+			std::vector<int> id(from.nodes.size(), -1);
+			return import(from, n, id);
+		}
+		// hash of the whole tree, equal trees hash equal wherever their nodes are
+		uint64_t Hash() const {
+			std::vector<uint64_t> h(nodes.size());
+			for (size_t i = 0; i < nodes.size(); i++) { // kids are made before parents
+				uint64_t v = nodes[i].type + 1;
+				auto mix = [&v](uint64_t w) { v ^= w + 0x9e3779b97f4a7c15ull + (v << 6) + (v >> 2); };
+				for (auto w : nodes[i].set) mix(w);
+				for (int k : nodes[i].kids) mix(h[k]);
+				h[i] = v;
+			}
+			return root == -1 ? 0 : h[root];
+		}
+		// simplified tree of a regex syntax tree, refs are trees a referring leaf stands for (see RegexProcesser::ProcessRegex)
+		static RegexAst FromTree(const RegexTree& tree, const std::vector<const RegexAst*>& refs = {}) {
+			RegexAst ast;
+			std::vector<int> id(tree.nodes.size());
+			for (size_t i = 0; i < tree.nodes.size(); i++) { // children come before parents
+				const auto& n = tree.nodes[i];
+				switch (n.type)
+				{
+				case RegexNode::Leaf: id[i] = n.ref == -1 ? ast.MakeSet(n.chr) : ast.Import(*refs[n.ref], refs[n.ref]->root); break;
+				case RegexNode::Concat: id[i] = ast.Make(Concat, { id[n.left], id[n.right] }); break;
+				case RegexNode::Alter: id[i] = ast.Make(Alter, { id[n.left], id[n.right] }); break;
+				case RegexNode::Star: id[i] = ast.Make(Star, { id[n.left] }); break;
+				case RegexNode::Plus: id[i] = ast.Make(Plus, { id[n.left] }); break;
+				case RegexNode::Optional: id[i] = ast.Make(Optional, { id[n.left] }); break;
+				case RegexNode::Repeat: id[i] = ast.Repeat(id[n.left], n.min, n.max); break;
+				}
+			}
+			ast.root = tree.root == -1 ? -1 : id[tree.root];
+			if (ast.root != -1 && ast.nodes[ast.root].size > EXPAND_MAX) throw std::exception("expression too large"); // like referrences doubled over and over
+			return ast;
+		}
+		// simplified tree of a regular expression
+		static RegexAst Parse(const std::string& regex) {
+			return FromTree(RegexTree::FromPostfix(RegexProcesser::ProcessRegex(regex)));
+		}
+		// simplified tree of a regular expression referring to other ones by '`name`',
+		// resolve gives the tree of a name, which is copied in and not parsed again
+		template<typename Resolve>
+		static RegexAst Parse(const std::string& regex, Resolve resolve) {
+			std::vector<std::string> names;
+			auto tree = RegexTree::FromPostfix(RegexProcesser::ProcessRegex(regex, &names));
+			std::vector<const RegexAst*> refs;
+			for (const auto& name : names) refs.push_back(resolve(name));
+			return FromTree(tree, refs);
+		}
+		// back to a binary syntax tree, a set of many ranges is an alternation of them
+		RegexTree ToTree() const {
+			RegexTree tree;
+			if (root != -1) tree.root = toTree(tree, root);
+			return tree;
+		}
+	private:
+		struct keyHash {
+			size_t operator()(const node& n) const {
+				size_t h = n.type;
+				for (auto w : n.set) h ^= w + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+				for (int k : n.kids) h ^= (size_t)k + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+				return h;
+			}
+		};
+		struct keyEqual {
+			bool operator()(const node& a, const node& b) const {
+				return a.type == b.type && a.set == b.set && a.kids == b.kids;
+			}
+		};
+		std::unordered_map<node, int, keyHash, keyEqual> ids; // node to its id
+
+		int import(const RegexAst& from, int n, std::vector<int>& id) {
+			if (id[n] != -1) return id[n];
+			const auto& nd = from.nodes[n];
+			std::vector<int> kids;
+			for (int k : nd.kids) kids.push_back(import(from, k, id));
+			return id[n] = intern(nd.type, std::move(kids), nd.set); // simplified there already
+		}
+		int intern(Type type, std::vector<int> kids, const bytes& set) {
+			node n{ type, set, std::move(kids) };
+			auto it = ids.find(n);
+			if (it != ids.end()) return it->second;
+			if (type == Set) n.size = 1;
+			for (int k : n.kids) n.size = std::min(n.size + nodes[k].size, EXPAND_MAX + 1); // saturated, never overflows
+			nodes.push_back(n);
+			ids.emplace(std::move(n), (int)nodes.size() - 1);
+			return (int)nodes.size() - 1;
+		}
+		// items of a concatenation, a single item for other nodes
+		std::vector<int> items(int n) const {
+			return nodes[n].type == Concat ? nodes[n].kids : std::vector<int>{ n };
+		}
+		// flatten nested concatenations and join repeats with closures
+		std::vector<int> concat(const std::vector<int>& kids) {
+			std::vector<int> out;
+			for (int k : kids)
+				for (int item : items(k)) {
+					Type type = nodes[item].type;
+					int body = type == Star ? nodes[item].kids[0] : -1; // of x*
+					if (!out.empty()) {
+						Type last = nodes[out.back()].type;
+						int lastBody = last == Star || last == Plus ? nodes[out.back()].kids[0] : -1;
+						if (last == Star && lastBody == item) { // x* x -> x+
+							out.back() = closure(Plus, item);
+							continue;
+						}
+						if (body != -1 && lastBody == body) // x* x* -> x*, x+ x* -> x+
+							continue;
+					}
+					if (body != -1) { // x x* -> x+, x may be a concatenation
+						auto seq = items(body);
+						if (out.size() >= seq.size() && std::equal(seq.begin(), seq.end(), out.end() - seq.size())) {
+							out.resize(out.size() - seq.size());
+							out.push_back(closure(Plus, body));
+							continue;
+						}
+					}
+					out.push_back(item);
+				}
+			return out;
+		}
+		// flatten nested alternations, factor common prefixes and join sets
+		int alter(const std::vector<int>& kids) {
+			std::vector<int> flat;
+			for (int k : kids) {
+				if (nodes[k].type == Alter) flat.insert(flat.end(), nodes[k].kids.begin(), nodes[k].kids.end());
+				else flat.push_back(k);
+			}
+			std::sort(flat.begin(), flat.end()); // alternatives of a rule are in no order, sorted so equal ones meet
+			flat.erase(std::unique(flat.begin(), flat.end()), flat.end());
+
+			// group alternatives by their first item
+			std::map<int, std::vector<int>> groups;
+			std::vector<int> heads; // first items in order found
+			for (int k : flat) {
+				int head = items(k)[0];
+				auto& g = groups[head];
+				if (g.empty()) heads.push_back(head);
+				g.push_back(k);
+			}
+			std::vector<int> alts;
+			bytes set{};
+			bool hasSet = false;
+			for (int head : heads) {
+				const auto& g = groups[head];
+				int alt = g[0];
+				if (g.size() > 1) { // head (rest1 | rest2 | ...), a rest may be empty
+					std::vector<int> rests;
+					bool empty = false;
+					for (int k : g) {
+						auto it = items(k);
+						if (it.size() == 1) empty = true;
+						else rests.push_back(Make(Concat, std::vector<int>(it.begin() + 1, it.end())));
+					}
+					int rest = rests.size() == 1 ? rests[0] : Make(Alter, rests);
+					if (empty) rest = closure(Optional, rest);
+					alt = Make(Concat, { head, rest });
+				}
+				if (nodes[alt].type == Set) { // single chars and ranges join a set
+					for (int w = 0; w < 4; w++) set[w] |= nodes[alt].set[w];
+					hasSet = true;
+				}
+				else alts.push_back(alt);
+			}
+			if (hasSet) alts.push_back(intern(Set, {}, set));
+			if (alts.size() == 1) return alts[0];
+			std::sort(alts.begin(), alts.end());
+			return intern(Alter, std::move(alts), {});
+		}
+		// closure of a node, closures of closures are one closure
+		int closure(Type type, int kid) {
+			Type inner = nodes[kid].type;
+			if (inner == Star || inner == Plus || inner == Optional) {
+				int body = nodes[kid].kids[0];
+				if (inner == type) return kid; // x** -> x*, x++ -> x+, x?? -> x?
+				return closure(Star, body); // any other two are x*, like x+? and x*+
+			}
+			return intern(type, { kid }, {});
+		}
+		int toTree(RegexTree& tree, int n) const {
+			const auto& nd = nodes[n];
+			int r = -1;
+			switch (nd.type)
+			{
+			case Set:
+				for (const auto& chr : Ranges(nd.set)) {
+					int leaf = tree.NewNode(RegexNode::Leaf, -1, -1, chr);
+					r = r == -1 ? leaf : tree.NewNode(RegexNode::Alter, r, leaf);
+				}
+				return r;
+			case Concat:
+			case Alter:
+				for (int k : nd.kids) {
+					int sub = toTree(tree, k);
+					r = r == -1 ? sub : tree.NewNode(nd.type == Concat ? RegexNode::Concat : RegexNode::Alter, r, sub);
+				}
+				return r;
+			default:
+				r = toTree(tree, nd.kids[0]);
+				return tree.NewNode(nd.type == Star ? RegexNode::Star : nd.type == Plus ? RegexNode::Plus : RegexNode::Optional, r);
+			}
+		}
+	};
+}
@@ -137,7 +137,7 @@ namespace hscp {
 
 			auto para = s_it->second.second;
 			if (s_it->second.first == "Leaf") // for leaf get token val
-				para[1] = node->children.front()->token.content;
+				para[1] = node->children.front()->token.Content();
 			return actions[s_it->second.first](para, castn); // do action by sematic option
 		}
 	public:
@@ -9,47 +9,107 @@
 #include "SematicLoader.h"
 #include "SematicProcesser.h"
 #include "intermediate.h"
+#include "LexBuilder.h"
+#include "LexCache.h"
+#include "LexCodeGen.h"
+#ifdef HSCP_GENERATED_LEXER
+#include "GeneratedLexer.h" // written by -genlex, lexer is built into the program
+#endif
+#include "LexBenchmark.h"
 using namespace std;
-// get an regex automaton
-hscp::Automaton getAutos() {
+// file of lexical rules
 #ifdef _DEBUG
-	constexpr auto route = "Data\\lex-define.txt";
+constexpr auto route = "Data\\lex-define.txt";
 #else
-	constexpr auto route = "lex-define.txt";
+constexpr auto route = "lex-define.txt";
 #endif
+// get compiled lexer, from cache when lexical rules are not changed
+hscp::LexTable getLexer(hscp::LexBuild how = hscp::LexBuild::Thompson, bool cache = true, bool hashKeywords = false) {
+	if (cache)
+		return hscp::LexCache::Load(route, how, hashKeywords);
 
-	hscp::Automaton at;
+	hscp::LexTable tb;
 	// load expressions
-	hscp::FileLoader(route, [](const auto& err) {}, [&at](const vector<hscp::token_define>& defs) {
-		for (const auto& d : defs) { // for each expression
-			// convert to postfix expression then to NFA
-			auto nfa = hscp::Automaton::RegexPost2NFA(hscp::RegexProcesser::ProcessRegex(d.expr), d.id);
-			// to DFA
-			auto dfa = hscp::DFAConverter::Nfa2Dfa(nfa);
-			// minimize
-			auto mindfa = hscp::DFAminimizer(dfa);
-			// merge automatons to one big automaton
-			at = hscp::Automaton::Merge(at, mindfa);
-		}
+	hscp::FileLoader(route, [](const auto& err) {}, [&tb, how, hashKeywords](const vector<hscp::token_define>& defs) {
+		tb = hscp::BuildTable(defs, how, hashKeywords); // regex to minimized dfa, then table
 		});
 
-	at = hscp::DFAConverter::Nfa2Dfa(at);  // there're epsilons and transitions accept same inputs after merge
-
-	return std::move(at);
+	return tb;
+}
+// get lexer making its dfa states while scanning, from merged nfa of rules
+hscp::LazyDFA getLazyLexer() {
+	hscp::LazyDFA lazy{ hscp::Automaton() };
+	hscp::FileLoader(route, [](const auto& err) {}, [&lazy](const vector<hscp::token_define>& defs) {
+		lazy = hscp::BuildLazy(defs); // nfa of each mode
+		});
+	return lazy;
+}
+// run the lexer benchmark suite on the lexical rules and write results as json
+bool runSuite(const vector<size_t>& sizes, const string& json) {
+	ofstream fout(json, ios::trunc);
+	if (!fout) return false;
+	hscp::FileLoader(route, [](const auto& err) {}, [&](const vector<hscp::token_define>& defs) {
+		hscp::BenchSuite(defs, sizes, fout);
+		});
+	return (bool)fout;
 }
 
 int main(int argc, char** argv) {
+	hscp::LexBuild build = hscp::LexBuild::Thompson;
+	bool cache = true;
+	bool hashKeywords = false;
+	bool lazy = false;
+	unsigned threads = 1;
+	vector<size_t> suiteSizes = { 1 << 20, 16 << 20 };
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "-bench") { // lexer construction and scanning benchmark
+			hscp::BenchKeywords();
+			auto lexer = getLexer(build, false);
+			hscp::Matcher checked(lexer), checkedLazy(getLazyLexer());
+			if (hscp::CheckComments(checked) && hscp::CheckComments(checkedLazy)) cout << "comment check ok\n";
+			if (hscp::CheckRepetitions()) cout << "repetition check ok\n";
+			hscp::BenchScan(lexer, "spaced", hscp::SpacedSource(16 << 20));
+			auto wordy = hscp::WordySource(16 << 20);
+			hscp::BenchScan(lexer, "wordy", wordy);
+			hscp::BenchScan(getLexer(build, false, true), "wordy+kw", wordy);
+			hscp::BenchThreads(lexer, hscp::SpacedSource(64 << 20));
+			hscp::BenchLazy(hscp::KeywordRules(400), "keywords", wordy);
+			auto tails = hscp::TailSource(8 << 20);
+			hscp::BenchLazy(hscp::TailRules(8), "tail 8", tails);
+			hscp::BenchLazy(hscp::TailRules(14), "tail 14", tails);
+			hscp::BenchLazy(hscp::TailRules(18), "tail 18", tails, false); // too many states for table
+			return 0;
+		}
+		if (arg == "-mb" && i + 1 < argc) // also measure a source of n megabytes in -suite, large ones are written to a file
+			suiteSizes.push_back((size_t)atoll(argv[i + 1]) << 20);
+		if (arg == "-suite" && i + 1 < argc) // lexer benchmark suite on synthetic tiny sources, results written as json
+			return runSuite(suiteSizes, argv[i + 1]) ? 0 : 1;
+		if (arg == "-direct") // build lexer by followpos instead of nfa
+			build = hscp::LexBuild::Direct;
+		if (arg == "-nocache") // always build lexer from rules
+			cache = false;
+		if (arg == "-kwhash") // find reserve words by hash instead of dfa states
+			hashKeywords = true;
+		if (arg == "-lazy") // make dfa states while scanning instead of building the whole dfa first
+			lazy = true;
+		if (arg == "-j" && i + 1 < argc) // threads to scan a large source, 0 for all cores
+			threads = (unsigned)atoi(argv[i + 1]);
+		if (arg == "-genlex" && i + 1 < argc) { // write lexer as c++ header then quit
+			return hscp::LexCodeGen::Generate(getLexer(build, false, hashKeywords), argv[i + 1]) ? 0 : 1;
+		}
+	}
 	string file = "Data\\source.txt";
 	//if (argc == 2)
 	//	file = argv[1]; // source file from parameter
 	//else return 0;
 
-	auto at = getAutos();
 	// init matcher
-	hscp::Matcher mc(at);
-	// begin match
-	auto tokens = mc.ReadFile(file);
-
+#ifdef HSCP_GENERATED_LEXER
+	hscp::Matcher mc(hscp::GeneratedLexer());
+#else
+	hscp::Matcher mc = lazy ? hscp::Matcher(getLazyLexer()) : hscp::Matcher(getLexer(build, cache, hashKeywords));
+#endif
 	// load grammar
 	hscp::GrammarLoader ld;
 	//ld.Print();
@@ -59,7 +119,16 @@ int main(int argc, char** argv) {
 	
 	auto t = lrat.LR1Table();
 	
-	hscp::Analyzer ana(lrat, t, tokens);
+	// begin match, the parser pulls tokens as it goes, with -j the source is scanned by threads first
+	auto analyze = [&]() {
+		if (threads != 1) {
+			auto tokens = mc.ScanFile(file, threads);
+			return hscp::Analyzer(lrat, t, tokens);
+		}
+		auto stream = mc.StreamFile(file);
+		return hscp::Analyzer(lrat, t, stream);
+	};
+	auto ana = analyze();
 	ana.PrintErrors();
 
 	auto& atree = ana.GetAnalyzeTree();